@@ -1,89 +1,381 @@
-#include <cstdio>
-#include <cstdlib>
-
-#include "legion.h"
-
-#define ROW 5
-#define COL 5
-
-using namespace LegionRuntime::HighLevel;
-using namespace LegionRuntime::Accessor;
-
-enum TASK_ID  {
-  TOP_LEVEL_TASK_ID,
-  PRINT_LR_TASK_ID,
-  GENERATE_RHS_TASK_ID,
-  GENERATE_X0_TASK_ID,
-  TRIM_ROW_TASK_ID,
-  TRIM_RHS_TASK_ID,
-  TRIM_FIELD_TASK_ID,
-  SOLVE_TASK_ID
+#include "array_populate.h"
+
+LegionRuntime::Logger::Category log_solver("solver");
+
+/* The generated matrix: entries in [0, 1000), plus diagonal on A(i, i) */
+struct InitMatrixArgs {
+  RandomArgs random;
+  double diagonal;
 };
 
-enum FieldIDs {
-  FID_RHS,
-  FID_TRIMMED_COL,
-  FID_SOLVE
+IndexPartition create_row_blocks(Context ctx, HighLevelRuntime *runtime,
+                                 IndexSpace is, const std::vector<int> &row_lo,
+                                 bool matrix)
+{
+  Domain dom = runtime->get_index_space_domain(ctx, is);
+  const int num_blocks = row_lo.size() - 1;
+
+  DomainColoring coloring;
+  for(int b = 0; b < num_blocks; b++) {
+    if(dom.get_dim() == 1) {
+      Rect<1> block(Point<1>(row_lo[b]), Point<1>(row_lo[b + 1] - 1));
+      coloring[b] = Domain::from_rect<1>(block);
+    } else {
+      Rect<2> rect = dom.get_rect<2>();
+      if(matrix)
+        rect = mat_rect(rect);
+      Rect<2> block(make_point(row_lo[b], rect.lo[1]),
+                    make_point(row_lo[b + 1] - 1, rect.hi[1]));
+      coloring[b] = Domain::from_rect<2>(matrix ? mat_rect(block) : block);
+    }
+  }
+
+  Rect<1> color_rect(Point<1>(0), Point<1>(num_blocks - 1));
+  return runtime->create_index_partition(ctx, is,
+      Domain::from_rect<1>(color_rect), coloring, true /* disjoint */);
+}
+
+/* One line of the -csv output */
+struct BenchRecord {
+  int n, nrhs, batches, blocks, cpus;
+  const char *engine, *precision;
+  double generate_ms, factor_ms, rhs_ms, solve_ms;
+  double factor_gflops, factor_gbs, solve_gflops, solve_gbs;
 };
 
+/*
+ * Appends record to the CSV file at path, after a header line if the file
+ * is new, so that the runs of a sweep collect in one table.
+ */
+static void append_bench_record(const char *path, const BenchRecord &record)
+{
+  struct stat st;
+  const bool fresh = (stat(path, &st) != 0) || (st.st_size == 0);
+  FILE *file = fopen(path, "a");
+  if(file == NULL) {
+    printf("\n Cannot append to %s\n", path);
+    return;
+  }
+  if(fresh)
+    fprintf(file, "n,nrhs,batches,blocks,cpus,engine,precision,layout,kernels,mapper,"
+                  "generate_ms,factor_ms,rhs_ms,solve_ms,"
+                  "factor_gflops,factor_gbs,solve_gflops,solve_gbs\n");
+  fprintf(file, "%d,%d,%d,%d,%d,%s,%s,%s,%s,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+          record.n, record.nrhs, record.batches, record.blocks, record.cpus,
+          record.engine, record.precision, matrix_layout_name(), kernel_isa_name(),
+          solver_mapper_name(), record.generate_ms, record.factor_ms, record.rhs_ms,
+          record.solve_ms, record.factor_gflops, record.factor_gbs,
+          record.solve_gflops, record.solve_gbs);
+  fclose(file);
+}
+
 void top_level_task(const Task *task,
                   const std::vector<PhysicalRegion> &regions, Context ctx,
                   HighLevelRuntime *runtime)
 {
-  int field_id[COL];
+  int n = 5;      // number of unknowns
+  int nrhs = 1;   // number of right hand sides
+  int num_blocks = 0;   // row blocks, defaults to one per CPU processor
+  bool tiled_lu = false;  // -lu tiled: factor with the tiled LU engine
+  bool fused = true;      // -unfused: separate GENERATE_X0 and TRIM_ROW launches
+  int tile_size = 128;
+  ProcessGrid grid = { 0, 0, true };  // -grid PxQ, -dist cyclic|block: tile owners
+  int num_batches = 1;    // -batches: RHS batches solved with the same factors
+  bool use_cg = false;    // -solver cg: sparse test or -matrix coordinate matrix with conjugate gradient
+  double tol = 1e-10;     // -tol: CG or refinement stops when ||r|| / ||b|| < tol
+  int max_iters = 0;      // -maxit: iteration limit, defaults to n for CG, 30 corrections
+  bool mixed = false;     // -precision mixed: float factors refined in double
+  unsigned long long seed = 1;  // -seed: generator seed of the matrix and the RHS
+  const char *matrix_path = NULL; // -matrix: load A from a file, sets n
+  const char *rhs_path = NULL;    // -rhs: load the RHS from a file, sets nrhs
+  const char *out_path = NULL;    // -out: write the solution of the last batch
+  bool dump = false;      // -dump: print the matrix and the last solution
+  const char *csv_path = NULL;    // -csv: append the phase timings to a CSV file
+  bool trace = true;      // -notrace: analyse every elimination step afresh
+  bool verify = false;    // -verify: check the last batch against A and b
+  bool spd = false;       // -spd: the matrix is SPD, factor it with Cholesky
+  const char *band = NULL;  // -band K|auto: store and solve the band only
+  int small = 0;          // -small N: many independent N x N systems instead
+  int num_systems = 100000; // -systems: how many, per batch
+  const char *cache_dir = NULL; // -cache DIR: keep the factors of A there, keyed by its hash
 
-  Rect<1> elem_rect(Point<1>(0), Point<1>(ROW - 1));
-  IndexSpace is = runtime->create_index_space(ctx, Domain::from_rect<1>(elem_rect));
-  FieldSpace fs = runtime->create_field_space(ctx);
   {
-    FieldAllocator allocator = runtime->create_field_allocator(ctx, fs);
+    const InputArgs &command_args = HighLevelRuntime::get_input_args();
+    for(int i = 1; i < command_args.argc; i++) {
+      if(!strcmp(command_args.argv[i], "-n"))
+        n = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-nrhs"))
+        nrhs = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-p"))
+        num_blocks = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-lu"))
+        tiled_lu = !strcmp(command_args.argv[++i], "tiled");
+      if(!strcmp(command_args.argv[i], "-b"))
+        tile_size = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-grid"))
+        if(sscanf(command_args.argv[++i], "%dx%d", &grid.rows, &grid.cols) != 2)
+          grid.rows = grid.cols = 0;
+      if(!strcmp(command_args.argv[i], "-dist"))
+        grid.cyclic = strcmp(command_args.argv[++i], "block");
+      if(!strcmp(command_args.argv[i], "-unfused"))
+        fused = false;
+      if(!strcmp(command_args.argv[i], "-batches"))
+        num_batches = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-solver"))
+        use_cg = !strcmp(command_args.argv[++i], "cg");
+      if(!strcmp(command_args.argv[i], "-tol"))
+        tol = atof(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-maxit"))
+        max_iters = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-precision"))
+        mixed = !strcmp(command_args.argv[++i], "mixed");
+      if(!strcmp(command_args.argv[i], "-seed"))
+        seed = strtoul(command_args.argv[++i], NULL, 10);
+      if(!strcmp(command_args.argv[i], "-matrix"))
+        matrix_path = command_args.argv[++i];
+      if(!strcmp(command_args.argv[i], "-rhs"))
+        rhs_path = command_args.argv[++i];
+      if(!strcmp(command_args.argv[i], "-out"))
+        out_path = command_args.argv[++i];
+      if(!strcmp(command_args.argv[i], "-dump"))
+        dump = true;
+      if(!strcmp(command_args.argv[i], "-csv"))
+        csv_path = command_args.argv[++i];
+      if(!strcmp(command_args.argv[i], "-notrace"))
+        trace = false;
+      if(!strcmp(command_args.argv[i], "-verify"))
+        verify = true;
+      if(!strcmp(command_args.argv[i], "-spd"))
+        spd = true;
+      if(!strcmp(command_args.argv[i], "-band"))
+        band = command_args.argv[++i];
+      if(!strcmp(command_args.argv[i], "-small"))
+        small = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-systems"))
+        num_systems = atoi(command_args.argv[++i]);
+      if(!strcmp(command_args.argv[i], "-cache"))
+        cache_dir = command_args.argv[++i];
+    }
+  }
 
-    for(int i = 0; i < COL; i++)  {
-      field_id[i] = allocator.allocate_field(sizeof(double));
+  MatrixFile matrix_file, rhs_file;
+  if(matrix_path != NULL) {
+    if(!open_matrix_file(matrix_path, matrix_file))
+      return;
+    if(matrix_file.rows != matrix_file.cols) {
+      printf("\n %s: the matrix is %d x %d, not square\n", matrix_path,
+             matrix_file.rows, matrix_file.cols);
+      return;
+    }
+    n = matrix_file.rows;
+  }
+  if(rhs_path != NULL) {
+    if(!open_matrix_file(rhs_path, rhs_file))
+      return;
+    if(rhs_file.rows != n) {
+      printf("\n %s: %d rows for a system of %d unknowns\n", rhs_path, rhs_file.rows, n);
+      return;
     }
+    nrhs = rhs_file.cols;
   }
 
-  LogicalRegion input_lr = runtime->create_logical_region(ctx, is, fs);
+  if((n < 2) || (nrhs < 1) || (num_batches < 1)) {
+    printf("\n Invalid system size: n = %d, nrhs = %d, batches = %d\n", n, nrhs, num_batches);
+    return;
+  }
 
-  RegionRequirement req(input_lr, READ_WRITE, EXCLUSIVE, input_lr);
+  if(tile_size < 1)
+    tile_size = 1;
+  if(tile_size > n)
+    tile_size = n;
 
-  /* specify which fields on logical regions to request */
-  for(int i = 0; i < COL; i++)  {
-    req.add_field(field_id[i]);
+  int num_cpus = 0;
+  {
+    std::set<Processor> all_procs;
+    Machine::get_machine().get_all_processors(all_procs);
+    for(std::set<Processor>::const_iterator it = all_procs.begin();
+        it != all_procs.end(); it++) {
+      if(it->kind() == Processor::LOC_PROC)
+        num_cpus++;
+    }
+  }
+  if(num_blocks <= 0)
+    num_blocks = num_cpus;
+
+  // The batched path has no n x n system, so num_blocks is not bounded by n
+  if(small > 0) {
+    if(num_systems < 1) {
+      printf("\n Invalid number of systems: %d\n", num_systems);
+      return;
+    }
+    batched_solve(ctx, runtime, small, num_systems, num_batches, num_blocks, seed, verify);
+    printf("\n Done!\n");
+    return;
   }
 
-  // req.add_field(field_id[0]);
-  // req.add_field(field_id[1]);
-  // req.add_field(field_id[2]);
-  // req.add_field(field_id[3]);
-  // req.add_field(field_id[4]);
+  // One tile owner per CPU by default, on the squarest grid
+  if((grid.rows < 1) || (grid.cols < 1)) {
+    grid.rows = 1;
+    for(int p = 1; p * p <= num_cpus; p++)
+      if(num_cpus % p == 0)
+        grid.rows = p;
+    grid.cols = std::max(1, num_cpus / grid.rows);
+  }
+  if(num_blocks < 1)
+    num_blocks = 1;
+  if(num_blocks > n)
+    num_blocks = n;
+
+  // The float factors come from the fused row elimination only
+  if(mixed && (tiled_lu || !fused)) {
+    printf("\n -precision mixed factors with the fused row elimination");
+    tiled_lu = false;
+    fused = true;
+  }
 
-  InlineLauncher input_launcher(req);
-  PhysicalRegion input_region = runtime->map_region(ctx, input_launcher);
-  input_region.wait_until_valid();
+  std::vector<int> row_lo(num_blocks + 1);
+  for(int b = 0; b <= num_blocks; b++)
+    row_lo[b] = (int) (((long long) n * b) / num_blocks);
 
-  RegionAccessor<AccessorType::Generic, double> region_accessor[COL];
+  if(use_cg) {
+    if((matrix_path != NULL) && (matrix_file.format != FILE_MM_COORDINATE)) {
+      printf("\n %s: -solver cg loads Matrix Market coordinate files only\n", matrix_path);
+      return;
+    }
+    sparse_cg_solve(ctx, runtime, n, (matrix_path != NULL) ? &matrix_file : NULL, row_lo,
+                    tol, (max_iters > 0) ? max_iters : n, dump);
+    printf("\n Done!\n");
+    return;
+  }
 
-  for(int i = 0; i < COL; i++)  {
-    region_accessor[i] = input_region.get_field_accessor(field_id[i]).typeify<double>();
+  if(spd) {
+    cholesky_solve(ctx, runtime, n, nrhs, num_batches, tile_size, grid, seed,
+                   (matrix_path != NULL) ? &matrix_file : NULL,
+                   (rhs_path != NULL) ? &rhs_file : NULL, out_path, verify);
+    printf("\n Done!\n");
+    return;
   }
 
-  for(GenericPointInRectIterator<1> pir(elem_rect); pir; pir++) {
-    for(int i = 0; i < COL; i++)  {
-       region_accessor[i].write(DomainPoint::from_point<1>(pir.p), (rand() % 1000));
+  if(band != NULL) {
+    // The generator makes a band of K diagonals on each side
+    int kl = std::max(1, atoi(band)), ku = kl;
+    if(!strcmp(band, "auto")) {
+      if(matrix_path == NULL) {
+        printf("\n -band auto needs -matrix\n");
+        return;
+      }
+      double ts_detect = wall_time();
+      if(!detect_bandwidth(matrix_file, kl, ku))
+        return;
+      printf("\n %s: %d sub- and %d superdiagonals, found in %.3f ms", matrix_path, kl, ku,
+             (wall_time() - ts_detect) * 1e-3);
     }
+    band_solve(ctx, runtime, n, std::min(kl, n - 1), std::min(ku, n - 1), nrhs, num_batches,
+               num_blocks, seed, (matrix_path != NULL) ? &matrix_file : NULL,
+               (rhs_path != NULL) ? &rhs_file : NULL, out_path, verify);
+    printf("\n Done!\n");
+    return;
+  }
+
+  // Tiles are the unit of storage of the tiled layout, and only the tiled
+  // engine maps tiles. The layout does not pick the engine: that one does
+  // not pivot.
+  if((matrix_layout == LAYOUT_TILED) && !tiled_lu) {
+    printf("\n -layout tiled stores the tiles of -lu tiled; add -lu tiled or use -layout row\n");
+    return;
+  }
+
+  printf("\n Solving %d x %d system with %d batch(es) of %d right hand side(s) over %d row blocks (%s kernels, %s matrix, %s mapper)",
+         n, n, num_batches, nrhs, num_blocks, kernel_isa_name(), matrix_layout_name(),
+         solver_mapper_name());
+
+  SolverOptions options;
+  options.num_blocks = num_blocks;
+  options.tiled = tiled_lu;
+  options.tile_size = tile_size;
+  options.grid = grid;
+  options.fused = fused;
+  options.trace = trace;
+  options.mixed = mixed;
+  options.tol = tol;
+  options.max_iters = (max_iters > 0) ? max_iters : 30;
+  LinearSolver solver(ctx, runtime, options);
+
+  Rect<2> elem_rect(make_point(0, 0), make_point(n - 1, n - 1));
+  IndexSpace is = runtime->create_index_space(ctx, Domain::from_rect<2>(elem_rect));
+  FieldSpace fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, fs);
+    allocator.allocate_field(sizeof(double), FID_INPUT);
+    if(mixed)
+      allocator.allocate_field(sizeof(float), FID_FACTOR);
+    if(verify && !mixed)
+      allocator.allocate_field(sizeof(double), FID_ORIGINAL);
+  }
+
+  LogicalRegion input_lr = runtime->create_logical_region(ctx, is, fs);
+
+  // Row blocks of the matrix. Each TRIM_ROW_TASK point owns one block, so
+  // the points of an index launch never alias each other. The matrix is
+  // filled over the blocks that the solver eliminates over.
+  IndexPartition input_ip = solver.row_blocks(is, true);
+  LogicalPartition input_lp = runtime->get_logical_partition(ctx, input_lr, input_ip);
+  Rect<1> block_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain block_domain = Domain::from_rect<1>(block_bounds);
+
+  // The phases are timed apart, so the factorization starts on a complete matrix
+  double ts_generate = wall_time();
+  FutureMap init_fm;
+  if(matrix_path != NULL) {
+    init_fm = load_matrix_file(ctx, runtime, matrix_file, input_lr, input_lp, FID_INPUT,
+                               true /* matrix */, num_blocks);
+  } else {
+    // Every block generates its own rows; the entries depend only on the
+    // seed, so every layout and block count gets the same matrix. The
+    // tiled engine does not pivot, so it gets a diagonal above the sum of
+    // the other entries of its row, as the Cholesky and band paths do.
+    InitMatrixArgs matrix_args;
+    matrix_args.random.seed = seed;
+    matrix_args.random.stream = STREAM_MATRIX;
+    matrix_args.diagonal = tiled_lu ? 1000.0 * n : 0.0;
+    IndexLauncher init_launcher(INIT_MATRIX_TASK_ID, block_domain,
+      TaskArgument(&matrix_args, sizeof(matrix_args)), ArgumentMap());
+    init_launcher.add_region_requirement(
+      RegionRequirement(input_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, input_lr));
+    init_launcher.add_field(0, FID_INPUT);
+    init_fm = runtime->execute_index_space(ctx, init_launcher);
+  }
+  init_fm.wait_all_results();
+  if((matrix_path != NULL) && !file_blocks_loaded(init_fm, num_blocks)) {
+    printf("\n Loading %s failed\n", matrix_path);
+    return;
+  }
+  const double generate_ms = (wall_time() - ts_generate) * 1e-3;
+  printf("\n Matrix %s: %.3f ms\n", (matrix_path != NULL) ? "loaded" : "generated", generate_ms);
+
+  // The factorization overwrites A, except in mixed precision where it
+  // factors a float copy. b is never overwritten: the solve copies it to x.
+  const FieldID original_fid = mixed ? FID_INPUT : FID_ORIGINAL;
+  if(verify && !mixed) {
+    CopyLauncher save_launcher;
+    save_launcher.add_copy_requirements(
+      RegionRequirement(input_lr, READ_ONLY, EXCLUSIVE, input_lr),
+      RegionRequirement(input_lr, WRITE_DISCARD, EXCLUSIVE, input_lr));
+    save_launcher.add_src_field(0, FID_INPUT);
+    save_launcher.add_dst_field(0, FID_ORIGINAL);
+    runtime->issue_copy_operation(ctx, save_launcher);
   }
 
-  TaskLauncher print_lr_launcher(PRINT_LR_TASK_ID, TaskArgument(field_id, sizeof(field_id)));
-  print_lr_launcher.add_region_requirement(RegionRequirement(input_lr, READ_ONLY, EXCLUSIVE, input_lr));
-  for(int i = 0; i < COL; i++)  {
-    print_lr_launcher.add_field(0, field_id[i]);
+  if(dump) {
+    TaskLauncher print_lr_launcher(PRINT_LR_TASK_ID, TaskArgument(NULL, 0));
+    print_lr_launcher.add_region_requirement(RegionRequirement(input_lr, READ_ONLY, EXCLUSIVE, input_lr));
+    print_lr_launcher.add_field(0, FID_INPUT);
+    runtime->execute_task(ctx, print_lr_launcher);
   }
-  runtime->execute_task(ctx, print_lr_launcher);
 
 
-  Rect<1> elem_rect2(Point<1>(0), Point<1>(ROW - 1));
-  IndexSpace rhs_is = runtime->create_index_space(ctx, Domain::from_rect<1>(elem_rect2));
+  Rect<2> elem_rect2(make_point(0, 0), make_point(n - 1, nrhs - 1));
+  IndexSpace rhs_is = runtime->create_index_space(ctx, Domain::from_rect<2>(elem_rect2));
   FieldSpace rhd_fs = runtime->create_field_space(ctx);
   {
     FieldAllocator allocator = runtime->create_field_allocator(ctx, rhd_fs);
@@ -92,11 +384,8 @@ void top_level_task(const Task *task,
 
   LogicalRegion rhs_lr = runtime->create_logical_region(ctx, rhs_is, rhd_fs);
 
-  TaskLauncher generate_rhs_launcher(GENERATE_RHS_TASK_ID, TaskArgument(NULL, 0));
-  generate_rhs_launcher.add_region_requirement(
-        RegionRequirement(rhs_lr, WRITE_DISCARD, EXCLUSIVE, rhs_lr));
-  generate_rhs_launcher.add_field(0, FID_RHS);
-  runtime->execute_task(ctx, generate_rhs_launcher);
+  IndexPartition rhs_ip = solver.row_blocks(rhs_is, false);
+  LogicalPartition rhs_lp = runtime->get_logical_partition(ctx, rhs_lr, rhs_ip);
 
   /* GENERATE_X0_TASK */
   // TaskLauncher generate_x0_task_launcher;
@@ -128,114 +417,156 @@ void top_level_task(const Task *task,
   //   TaskArgument(&input, sizeof(input)));
   // }
 
-  // int ta = 3;
-  double trt_args[2] = {0};
-
-  ArgumentMap arg_map_trt;
-
-  FutureMap fm[COL];
-  for(int k = 0;  k < (COL - 1); k++) {
-
-    printf("\n Looping! %d", k);
-
-    // Launch bounds are between 0 and (ROW - 2 - k) because
-    // for each column, total number of rows decreases
-    Rect<1> launch_bounds_x0(Point<1>(0), Point<1>(ROW - 2 - k));
-    Domain launch_domain_x0 = Domain::from_rect<1>(launch_bounds_x0);
-    ArgumentMap arg_map_x0;
-
-    Rect<1> launch_bounds_trt(Point<1>(0), Point<1>(ROW - 2 - k));
-    Domain launch_domain_trt = Domain::from_rect<1>(launch_bounds_trt);
-
-    for(int i = 0; i < (ROW - 1 - k); i++)
-    {
-      // input reflects the DIVIDENT value in the task.
-      // It is increased by 1, because the first DIVIDENT will be in row 1
-
-      // the 'input' value is increased by k, as for each column, the pivot
-      // location is further below
-
-      int input = i + 1 + k;
-      arg_map_x0.set_point(DomainPoint::from_point<1>(Point<1>(i)),
-                            TaskArgument(&input, sizeof(input)));
-    }
-
-    IndexLauncher index_launcher_x0(GENERATE_X0_TASK_ID,
-        launch_domain_x0, TaskArgument(&k, sizeof(k)), arg_map_x0);
-    index_launcher_x0.add_region_requirement(
-    RegionRequirement(input_lr, READ_ONLY, EXCLUSIVE, input_lr));
-    index_launcher_x0.add_field(0, field_id[k]);
-    fm[k] = runtime->execute_index_space(ctx, index_launcher_x0);
-    fm[k].wait_all_results();
-
-
-    //  Go reduce the matrix. Necessary for generation of subsequent x0
-    //  generation of the next columns
-
-    for(int ii = 0; ii < (ROW - 1 - k); ii++) {
-      trt_args[0] = fm[k].get_result<double>(DomainPoint::from_point<1>(Point<1>(ii)));
-      trt_args[1] = ii + 1 + k;
-      printf("\n (ii, k) = (%d, %d)\n", ii, k);
-      arg_map_trt.set_point(DomainPoint::from_point<1>(Point<1>(ii)),
-                      TaskArgument(&trt_args, sizeof(trt_args)));
-    }
-    IndexLauncher index_launcher_trt(TRIM_ROW_TASK_ID,
-      launch_domain_trt, TaskArgument(&k, sizeof(k)), arg_map_trt);
-    index_launcher_trt.add_region_requirement(
-      RegionRequirement(input_lr, READ_WRITE, EXCLUSIVE, input_lr));
-
-    for(int i = 0; i < COL; i++)  {
-      index_launcher_trt.add_field(0, field_id[i]);
+  // Both engines factor the matrix in place, PA = LU (P = I for the tiled
+  // engine, which does not pivot), and leave the RHS alone: every batch of
+  // right hand sides below reuses the factors.
+  //
+  // Issuing the row elimination costs the runtime overhead of the steps:
+  // the tasks themselves run behind it, and only the wait blocks on them.
+  //
+  // With -cache, the hash of A names the file of its factors: a hit maps
+  // them in and skips the factorization, a miss writes them after it.
+  char cache_path[256];
+  unsigned long long matrix_hash = 0;
+  bool cache_hit = false;
+  if(cache_dir != NULL) {
+    double ts_hash = wall_time();
+    matrix_hash = matrix_content_hash(ctx, runtime, input_lr, input_lp, FID_INPUT, num_blocks);
+    const double hash_ms = (wall_time() - ts_hash) * 1e-3;
+    if(!factor_cache_path(cache_dir, matrix_hash, options, cache_path, sizeof(cache_path)))
+      cache_dir = NULL;
+    else {
+      double ts_load = wall_time();
+      cache_hit = load_factor_cache(ctx, runtime, cache_path, matrix_hash, solver, input_lr);
+      printf("\n Factor cache %s: %s (hash %.3f ms, %s %.3f ms)\n",
+             cache_hit ? "hit" : "miss", cache_path, hash_ms,
+             cache_hit ? "load" : "lookup", (wall_time() - ts_load) * 1e-3);
     }
-
-    /* handle RHS */
-    index_launcher_trt.add_region_requirement(
-      RegionRequirement(rhs_lr, READ_WRITE, EXCLUSIVE, rhs_lr));
-    index_launcher_trt.add_field(1, FID_RHS);
-
-    runtime->execute_index_space(ctx, index_launcher_trt);
   }
 
-  // Print the results
-  for(int k = 0; k < COL - 1; k++)
-  {
-    for(int i = 0; i < (ROW - 1 - k); i++)
-    {
-      double received_x0 = fm[k].get_result<double>(DomainPoint::from_point<1>(Point<1>(i)));
-      // printf("\n Received X0: %lf", received_x0);
+  if(tiled_lu && !cache_hit)
+    report_tiled_lu(n, tile_size, grid);
+
+  double ts_start = wall_time();
+  if(!cache_hit) {
+    FactorFuture factor_f = solver.factor(input_lr);
+    double ts_issued = wall_time();
+    factor_f.wait();
+    const double factor_ms = (wall_time() - ts_start) * 1e-3;
+    if(tiled_lu) {
+      printf("\n Factorization (tiled, %s): %.3f ms\n", matrix_layout_name(), factor_ms);
+    } else {
+      printf("\n Elimination (%s, %s, %s): %d launches, %.3f ms\n",
+             fused ? "fused" : "unfused", matrix_layout_name(), mixed ? "float" : "double",
+             solver.num_launches(), factor_ms);
+      printf("\n Issued %d steps in %.3f ms, %.1f us per step (%s)\n", n - 1,
+             (ts_issued - ts_start) * 1e-3, (ts_issued - ts_start) / std::max(1, n - 1),
+             trace ? "traced" : "untraced");
     }
-    printf("\n");
+  }
+  // A hit counts its load as the factorization
+  const double factor_ms = (wall_time() - ts_start) * 1e-3;
+
+  if((cache_dir != NULL) && !cache_hit) {
+    double ts_save = wall_time();
+    const bool saved = save_factor_cache(ctx, runtime, cache_path, matrix_hash, solver);
+    printf("\n Factors %s %s: %.3f ms\n", saved ? "written to" : "not written to",
+           cache_path, (wall_time() - ts_save) * 1e-3);
   }
 
-  // Logical region for storing the resutls
-  Rect<1> elem_rect_solve(Point<1>(0), Point<1>(ROW - 1));
-  IndexSpace solve_is = runtime->create_index_space(ctx, Domain::from_rect<1>(elem_rect_solve));
+  // Logical region for storing the resutls. It shares the index space and
+  // the row blocks of the RHS, which it starts as a copy of.
   FieldSpace solve_fs = runtime->create_field_space(ctx);
   {
       FieldAllocator allocator = runtime->create_field_allocator(ctx, solve_fs);
       allocator.allocate_field(sizeof(double), FID_SOLVE);
   }
-  LogicalRegion solve_lr = runtime->create_logical_region(ctx, solve_is, solve_fs);
-
+  LogicalRegion solve_lr = runtime->create_logical_region(ctx, rhs_is, solve_fs);
+  LogicalPartition solve_lp = runtime->get_logical_partition(ctx, solve_lr, rhs_ip);
+
+  double rhs_ms = 0, solve_ms = 0;
+  for(int batch = 0; batch < num_batches; batch++) {
+    double ts_batch = wall_time();
+
+    FutureMap rhs_fm;
+    if(rhs_path != NULL) {
+      // Every batch solves the same loaded right hand sides
+      if(batch == 0)
+        rhs_fm = load_matrix_file(ctx, runtime, rhs_file, rhs_lr, rhs_lp, FID_RHS,
+                                  false /* matrix */, num_blocks);
+    } else {
+      RandomArgs rhs_args = { seed, STREAM_RHS + batch };
+      IndexLauncher generate_rhs_launcher(GENERATE_RHS_TASK_ID, block_domain,
+        TaskArgument(&rhs_args, sizeof(rhs_args)), ArgumentMap());
+      generate_rhs_launcher.add_region_requirement(
+        RegionRequirement(rhs_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, rhs_lr));
+      generate_rhs_launcher.add_field(0, FID_RHS);
+      rhs_fm = runtime->execute_index_space(ctx, generate_rhs_launcher);
+    }
+    if((rhs_path == NULL) || (batch == 0))
+      rhs_fm.wait_all_results();
+    if((rhs_path != NULL) && (batch == 0) && !file_blocks_loaded(rhs_fm, num_blocks)) {
+      printf("\n Loading %s failed\n", rhs_path);
+      return;
+    }
+    double ts_solve = wall_time();
+    rhs_ms += (ts_solve - ts_batch) * 1e-3;
 
+    solver.solve(rhs_lr, solve_lr).get_void_result();
 
-  // Launch the solver task
-  TaskLauncher solve_launcher(SOLVE_TASK_ID, TaskArgument(NULL, 0));
-  solve_launcher.add_region_requirement(
-    RegionRequirement(input_lr, READ_ONLY, EXCLUSIVE, input_lr));
-  solve_launcher.add_region_requirement(
-    RegionRequirement(rhs_lr, READ_ONLY, EXCLUSIVE, rhs_lr));
-  solve_launcher.add_region_requirement(
-    RegionRequirement(solve_lr, READ_WRITE, EXCLUSIVE, solve_lr));
+    double ts_end = wall_time();
+    solve_ms += (ts_end - ts_solve) * 1e-3;
+    printf("\n Batch %d: %d RHS generated in %.3f ms, solved over %d blocks in %.3f ms\n",
+           batch, nrhs, (ts_solve - ts_batch) * 1e-3, num_blocks, (ts_end - ts_solve) * 1e-3);
+  }
 
-  // Add fields
-  for(int i = 0; i < COL; i++)  {
-    solve_launcher.add_field(0, field_id[i]);
+  // Rates of the phases. The byte counts are what the row elimination and
+  // the sweeps have to stream at the least: step k reads and writes the
+  // (n - k - 1) x (n - k) trailing block, and every solve reads L and U once.
+  // The tiled engine reuses its tiles in cache, so its rate is an effective one.
+  BenchRecord record;
+  record.n = n;
+  record.nrhs = nrhs;
+  record.batches = num_batches;
+  record.blocks = num_blocks;
+  record.cpus = num_cpus;
+  record.engine = cache_hit ? "cached" : (tiled_lu ? "tiled" : (fused ? "fused" : "unfused"));
+  record.precision = mixed ? "mixed" : "double";
+  record.generate_ms = generate_ms;
+  record.factor_ms = factor_ms;
+  record.rhs_ms = rhs_ms;
+  record.solve_ms = solve_ms;
+  {
+    const double dn = n;
+    const double elem_bytes = mixed ? sizeof(float) : sizeof(double);
+    const double factor_flops = 2.0 / 3.0 * dn * dn * dn;
+    const double factor_bytes = 2.0 / 3.0 * dn * dn * dn * elem_bytes;
+    const double solve_flops = 2.0 * dn * dn * nrhs * num_batches;
+    const double solve_bytes = dn * dn * elem_bytes * num_batches;
+    record.factor_gflops = (factor_ms > 0) ? factor_flops / (factor_ms * 1e6) : 0;
+    record.factor_gbs = (factor_ms > 0) ? factor_bytes / (factor_ms * 1e6) : 0;
+    record.solve_gflops = (solve_ms > 0) ? solve_flops / (solve_ms * 1e6) : 0;
+    record.solve_gbs = (solve_ms > 0) ? solve_bytes / (solve_ms * 1e6) : 0;
+  }
+  printf("\n Factorization: %.2f GFLOP/s (2/3 n^3), %.2f GB/s; solve: %.2f GFLOP/s, %.2f GB/s\n",
+         record.factor_gflops, record.factor_gbs, record.solve_gflops, record.solve_gbs);
+  if(csv_path != NULL)
+    append_bench_record(csv_path, record);
+
+  if(dump) {
+    TaskLauncher print_solution_launcher(PRINT_SOLUTION_TASK_ID, TaskArgument(NULL, 0));
+    print_solution_launcher.add_region_requirement(
+      RegionRequirement(solve_lr, READ_ONLY, EXCLUSIVE, solve_lr));
+    print_solution_launcher.add_field(0, FID_SOLVE);
+    runtime->execute_task(ctx, print_solution_launcher);
   }
-  solve_launcher.add_field(1, FID_RHS);
-  solve_launcher.add_field(2, FID_SOLVE);
 
-  runtime->execute_task(ctx, solve_launcher);
+  if(verify)
+    verify_solution(ctx, runtime, input_lr, input_lp, original_fid,
+                    rhs_lr, rhs_ip, solve_lr, num_blocks);
+
+  if(out_path != NULL)
+    write_solution_file(ctx, runtime, out_path, solve_lr, solve_lp, FID_SOLVE, num_blocks);
 
   // double trt_args[2];
   // Rect<1> launch_bounds_trt(Point<1>(0), Point<1>(ROW - 2));
@@ -309,42 +640,83 @@ void top_level_task(const Task *task,
   printf("\n Done!\n");
 }
 
-double generate_x0_task(const Task *task,
+const PivotCandidate ArgmaxReduction::identity = { -1.0, -1 };
+const double SumReduction::identity = 0.0;
+const ResidualNorms ResidualReduction::identity = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+/*
+ * Swaps rows k and p of a block from their staged copies, pivot[0..n) = row
+ * p and pivot[n..2n) = row k, and records the swap in perm. Whole rows are
+ * swapped, multipliers included, so the factors come out as PA = LU. The
+ * other row may live in another block, which swaps its own half.
+ */
+template<typename T>
+static void apply_row_swap(const DenseBlockOf<T> &block, const Rect<2> &rect,
+                           int k, int p, const double *pivot,
+                           const PhysicalRegion &perm_region, FieldID perm_fid)
+{
+  const int n = rect.hi[1] + 1;
+
+  if((k >= rect.lo[0]) && (k <= rect.hi[0])) {
+    RegionAccessor<AccessorType::Generic, int> perm =
+      perm_region.get_field_accessor(perm_fid).typeify<int>();
+    perm.write(DomainPoint::from_point<1>(Point<1>(k)), p);
+
+    if(p != k)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+        block.at(k, j) = pivot[j];
+  }
+
+  if((p != k) && (p >= rect.lo[0]) && (p <= rect.hi[0]))
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      block.at(p, j) = pivot[n + j];
+}
+
+void generate_x0_task(const Task *task,
             const std::vector<PhysicalRegion> &regions,
             Context ctx, HighLevelRuntime *runtime) {
 
   int my_rank = task->index_point.point_data[0];
   int input_col_id = *((const int*) task->args);
-  int input_row_id = *((const int*) task->local_args);
-  printf("\n Inside generate_x0_task() #%d| input = (%d,%d)", my_rank, input_row_id, input_col_id);
+  log_solver.debug("generate_x0_task #%d: column %d", my_rank, input_col_id);
+
+  // Every block takes part in every step; the ones above row k are done
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  if(rect.hi[0] < input_col_id)
+    return;
+  const int pivot_row = task->futures[0].get_result<PivotCandidate>().row;
 
   FieldID fid_orig = *(task->regions[0].privilege_fields.begin());
-  //
-  // int target_row = *((int *) task->args);
-  // printf("\n TaskArgument from gxt: #%d", target_row);
-  //
-  RegionAccessor<AccessorType::Generic, double> acc_orig =
-    regions[0].get_field_accessor(fid_orig).typeify<double>();
+  FieldID fid_pivot = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_mult = *(task->regions[2].privilege_fields.begin());
+  FieldID fid_perm = *(task->regions[3].privilege_fields.begin());
 
-  printf("\n Printing out rows on current column: \n");
-  for(int i = 0; i < ROW; i++) {
-    double x = acc_orig.read(DomainPoint::from_point<1>(i));
-    printf("\n -> %lf", x);
-  }
+  Rect<1> pivot_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  Rect<1> mult_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<1>();
+
+  DenseBlock orig = get_matrix_block(regions[0], fid_orig, rect);
+  const double *pivot = get_dense_vector(regions[1], fid_pivot, pivot_rect);
+  double *mult = get_dense_vector(regions[2], fid_mult, mult_rect) - mult_rect.lo[0];
 
-  double divident = acc_orig.read(DomainPoint::from_point<1>(input_row_id));
-  double divisor = acc_orig.read(DomainPoint::from_point<1>(input_col_id));
-  // double divisor = acc_orig.read(DomainPoint::from_point<1>(0));
-  // double divisor = acc_orig.read(DomainPoint::from_point<1>(target_row - 1));
-  // double result = 10;
-  double result = (divident/divisor);
+  apply_row_swap(orig, rect, input_col_id, pivot_row, pivot, regions[3], fid_perm);
 
-  printf("\n %lf %lf %lf", divident, divisor, result);
+  double divisor = pivot[input_col_id];
+  const int first_row = (rect.lo[0] > input_col_id) ? rect.lo[0] : (input_col_id + 1);
 
-  printf("\n X0  from function #%d: %lf\n", my_rank, result);
+  if(divisor == 0) {
+    log_solver.warning("matrix is singular: column %d has no nonzero pivot", input_col_id);
+    for(int input_row_id = first_row; input_row_id <= rect.hi[0]; input_row_id++)
+      mult[input_row_id] = 0;
+    return;
+  }
 
-  return result;
-  //return 0;
+  for(int input_row_id = first_row; input_row_id <= rect.hi[0]; input_row_id++) {
+    double divident = orig.at(input_row_id, input_col_id);
+    double result = (divident/divisor);
+    mult[input_row_id] = result;
+  }
 }
 
 void trim_row_task(const Task *task,
@@ -353,184 +725,196 @@ void trim_row_task(const Task *task,
 
   int my_rank = task->index_point.point_data[0];
 
-  printf("\n Inside trim_row_task() #%d", my_rank);
-
   // Future f_x = task->futures[0];
   // double x0 = f_x.get_result<double>();
   // printf("\n From trim_row_task: %lf\n", x0);
 
   // int target_row = *((int *) task->args);
 
-  const double *trt_args = ((const double *) task->local_args);
-
-  const double x0 = trt_args[0];
-  const int my_row = trt_args[1];
   // const int PIVOT_ROW = 0;
   const int PIVOT_ROW = *((const int *) task->args);
 
-  static int RHS_REDUCTION_STATUS[ROW] = {0};
+  log_solver.debug("trim_row_task #%d: pivot row %d", my_rank, PIVOT_ROW);
 
-  printf("\n Pivot Row: %d", PIVOT_ROW);
-  printf("\n Argument x0 #1: %lf", x0);
-  printf("\n Argument my_row #2: %d", my_row);
+  // Only the blocks with rows below the pivot have anything to update
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  if(rect.hi[0] <= PIVOT_ROW)
+    return;
 
-  /* Get all the field IDs */
-  FieldID trim_field_id[COL];
-  int tf = *(task->regions[0].privilege_fields.begin());
+  FieldID trim_field = *(task->regions[0].privilege_fields.begin());
+  FieldID pivot_field = *(task->regions[1].privilege_fields.begin());
+  FieldID mult_field = *(task->regions[2].privilege_fields.begin());
 
-  FieldID rhs_field = *(task->regions[1].privilege_fields.begin());
+  Rect<1> pivot_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  Rect<1> mult_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<1>();
 
-  // Figure out the other field IDs...
-  for(int i = 0; i < COL; i++)
-  {
-    trim_field_id[i] = tf++;
-    printf("\n TFI: %d", trim_field_id[i]);
-  }
-
-  // Accessor for the fields
-  RegionAccessor<AccessorType::Generic, double> region_accessor[COL];
-  for(int i = 0; i < COL; i++)  {
-    region_accessor[i] = regions[0].get_field_accessor(trim_field_id[i]).typeify<double>();
-  }
+  DenseBlock block = get_matrix_block(regions[0], trim_field, rect);
 
-  // Accessor for the fields
-  RegionAccessor<AccessorType::Generic, double> rhs_region_accessor;
-  rhs_region_accessor = regions[1].get_field_accessor(rhs_field).typeify<double>();
+  // Pivot row, A(PIVOT_ROW, :)
+  const double *pivot = get_dense_vector(regions[1], pivot_field, pivot_rect);
 
-  printf("\n Printing values before reduction: \n");
-  for(int i = 0; i < ROW; i++)  {
-    for(int j = 0; j < COL; j++)  {
-      double x = region_accessor[j].read(DomainPoint::from_point<1>(Point<1>(i)));
-      printf(" = %lf", x);
-    }
-    printf("\n");
-  }
+  // Multipliers of this block's rows, written by generate_x0_task
+  const double *mult = get_dense_vector(regions[2], mult_field, mult_rect) - mult_rect.lo[0];
 
-  printf("\n Printing RHS before reduction: \n");
-  for(int i = 0; i < ROW; i++)  {
-    double value = rhs_region_accessor.read(DomainPoint::from_point<1>(i));
-    printf(" %lf\n", value);
-  }
+  const int n = rect.hi[1] + 1;
+  const int first_row = (rect.lo[0] > PIVOT_ROW) ? rect.lo[0] : (PIVOT_ROW + 1);
+  const int rows = rect.hi[0] - first_row + 1;
 
-  for(int i = 0; i < COL; i++)  {
-    /* read the columns of row  */
-    double x = region_accessor[i].read(DomainPoint::from_point<1>(PIVOT_ROW));
-    x = x * x0;
-    double y = region_accessor[i].read(DomainPoint::from_point<1>(my_row));
-    region_accessor[i].write(DomainPoint::from_point<1>(my_row), (y - x));
-  }
+  std::vector<double> neg_mult(rows);
+  for(int i = 0; i < rows; i++)
+    neg_mult[i] = -mult[first_row + i];
 
-  if(RHS_REDUCTION_STATUS[PIVOT_ROW] == 0)  {
+  // Columns left of the pivot already hold multipliers in these rows
+  kernel_rank1_update(block, first_row, PIVOT_ROW + 1, rows, n - PIVOT_ROW - 1,
+                      &neg_mult[0], pivot + PIVOT_ROW + 1);
 
-    // Reduce the RHS
-    double x_rhs = rhs_region_accessor.read(DomainPoint::from_point<1>(PIVOT_ROW));
-    x_rhs = x_rhs * x0;
-    double y = rhs_region_accessor.read(DomainPoint::from_point<1>(my_row));
-    rhs_region_accessor.write(DomainPoint::from_point<1>(my_row), (y - x_rhs));
-
-    RHS_REDUCTION_STATUS[PIVOT_ROW] = 1;
-  }
-
-
-  printf("\n Printing out the reduced values: \n");
-  for(int i = 0; i < ROW; i++)  {
-    for(int j = 0; j < COL; j++)  {
-      double x = region_accessor[j].read(DomainPoint::from_point<1>(i));
-      printf(" = %lf", x);
-    }
-    printf("\n");
-  }
-
-  printf("\n Printing RHS after reduction: \n");
-  for(int i = 0; i < ROW; i++)  {
-    double value = rhs_region_accessor.read(DomainPoint::from_point<1>(i));
-    printf(" %lf\n", value);
-  }
+  // The eliminated column keeps the multipliers: it becomes column k of L
+  for(int i = 0; i < rows; i++)
+    block.at(first_row + i, PIVOT_ROW) = mult[first_row + i];
 }
 
-void solve_task(const Task *task,
+/*
+ * Fused elimination step for one row block: apply the block's half of the
+ * pivot row swap, then for every row below the pivot compute its multiplier
+ * A(row, k) / A(k, k), subtract the scaled pivot row from the row in the
+ * same pass and store the multiplier in place of A(row, k), where it
+ * becomes part of L. T is float when factoring in mixed precision.
+ */
+template<typename T>
+void eliminate_block_task(const Task *task,
             const std::vector<PhysicalRegion> &regions,
             Context ctx, HighLevelRuntime *runtime) {
 
-  static int SOLVE_INIT_STATUS[COL]= {0};
+  int my_rank = task->index_point.point_data[0];
+  const int PIVOT_ROW = *((const int *) task->args);
 
-  printf("\n Inside solve_task!");
+  log_solver.debug("eliminate_block_task #%d: pivot row %d", my_rank, PIVOT_ROW);
 
-  FieldID inp_field_id[COL];
+  // Every block takes part in every step; the ones above row k are done
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  if(rect.hi[0] < PIVOT_ROW)
+    return;
 
-  int f = *(task->regions[0].privilege_fields.begin());
+  FieldID inp_field = *(task->regions[0].privilege_fields.begin());
+  FieldID pivot_field = *(task->regions[1].privilege_fields.begin());
+  FieldID perm_field = *(task->regions[2].privilege_fields.begin());
 
-  FieldID fid_rhs = *(task->regions[1].privilege_fields.begin());
-  FieldID fid_solve = *(task->regions[2].privilege_fields.begin());
+  Rect<1> pivot_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
 
+  DenseBlockOf<T> block = get_typed_matrix_block<T>(regions[0], inp_field, rect);
+  const double *pivot = get_dense_vector(regions[1], pivot_field, pivot_rect);
 
-  // Figure out the other field IDs...
-  for(int i = 0; i < COL; i++)
-  {
-    inp_field_id[i] = f++;
-    printf("\n Input LR Field ID: %d", inp_field_id[i]);
-  }
+  apply_row_swap(block, rect, PIVOT_ROW,
+                 task->futures[0].get_result<PivotCandidate>().row,
+                 pivot, regions[2], perm_field);
 
-  RegionAccessor<AccessorType::Generic, double> acc_inp[COL];
-  for(int i = 0; i < COL; i++)
-  {
-    acc_inp[i] = regions[0].get_field_accessor(inp_field_id[i]).typeify<double>();
-  }
+  const int n = rect.hi[1] + 1;
+  const int first_row = (rect.lo[0] > PIVOT_ROW) ? rect.lo[0] : (PIVOT_ROW + 1);
+  const int rows = rect.hi[0] - first_row + 1;
 
-  RegionAccessor<AccessorType::Generic, double> acc_rhs =
-    regions[1].get_field_accessor(fid_rhs).typeify<double>();
+  const T divisor = pivot[PIVOT_ROW];
+  if(rows <= 0)
+    return;
+  if(divisor == 0) {
+    log_solver.warning("matrix is singular: column %d has no nonzero pivot", PIVOT_ROW);
+    return;
+  }
 
-  RegionAccessor<AccessorType::Generic, double> acc_solve =
-    regions[2].get_field_accessor(fid_solve).typeify<double>();
+  // Negated multipliers, so that the update is a += u v^T
+  std::vector<T> neg_mult(rows);
+  for(int i = 0; i < rows; i++) {
+    neg_mult[i] = -block.at(first_row + i, PIVOT_ROW) / divisor;
+    block.at(first_row + i, PIVOT_ROW) = -neg_mult[i];
+  }
 
-    // double x = region_accessor[i].read(DomainPoint::from_point<1>(PIVOT_ROW));
-    // x = x * x0;
-    // double y = region_accessor[i].read(DomainPoint::from_point<1>(my_row));
-    // region_accessor[i].write(DomainPoint::from_point<1>(my_row), (y - x));
+  // The staged pivot row in the precision of the block
+  std::vector<T> pivot_row(pivot + PIVOT_ROW + 1, pivot + n);
+  kernel_rank1_update(block, first_row, PIVOT_ROW + 1, rows, n - PIVOT_ROW - 1,
+                      &neg_mult[0], &pivot_row[0]);
+}
 
-  int i, j;
+/* Returns the block's largest |A(i, k)| over its rows i >= k */
+template<typename T>
+PivotCandidate pivot_search_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
 
-  // Initialize the sokve_kr
-  for(i = 0; i < COL; i++)  {
-    if(SOLVE_INIT_STATUS[i] == 0) {
-      acc_solve.write(DomainPoint::from_point<1>(i), 1);
-      SOLVE_INIT_STATUS[i] = 1;
+  const int k = *((const int *) task->args);
+
+  FieldID inp_field = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  if(rect.hi[0] < k)
+    return ArgmaxReduction::identity;
+  DenseBlockOf<T> block = get_typed_matrix_block<T>(regions[0], inp_field, rect);
+
+  PivotCandidate best = ArgmaxReduction::identity;
+  const int first_row = (rect.lo[0] > k) ? rect.lo[0] : k;
+  for(int i = first_row; i <= rect.hi[0]; i++) {
+    const double value = fabs(block.at(i, k));
+    if(value > best.abs_value) {
+      best.abs_value = value;
+      best.row = i;
     }
   }
+  return best;
+}
 
+/*
+ * Stages the rows swapped at step k: the block that holds the pivot row p
+ * adds it to slot 0 of the zeroed pivot region, the block that holds row k
+ * adds that row to slot 1. Every other block adds nothing, so the blocks
+ * can stage in parallel without knowing which of them owns the rows.
+ */
+template<typename T>
+void stage_pivot_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
 
-  for(i = COL - 1; i >= 0; i--) {
-    double target = acc_inp[i].read(DomainPoint::from_point<1>(i));
-    double y = 0;
+  const int k = *((const int *) task->args);
 
-    double temp_y = 0;
-    double temp_x = 0;
+  FieldID inp_field = *(task->regions[0].privilege_fields.begin());
+  FieldID pivot_field = *(task->regions[1].privilege_fields.begin());
 
-    for(j = (i + 1); j < COL; j++)  {
-      temp_x = acc_solve.read(DomainPoint::from_point<1>(j));
-      temp_y = acc_inp[j].read(DomainPoint::from_point<1>(i));
+  // Rows p and k are both at or below row k
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  if(rect.hi[0] < k)
+    return;
+  const int p = task->futures[0].get_result<PivotCandidate>().row;
+  DenseBlockOf<T> block = get_typed_matrix_block<T>(regions[0], inp_field, rect);
+  RegionAccessor<AccessorType::Generic, double> pivot =
+    regions[1].get_field_accessor(pivot_field).typeify<double>();
+  const int n = rect.hi[1] + 1;
 
-      y += (temp_x * temp_y);
+  if((p >= rect.lo[0]) && (p <= rect.hi[0]))
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      pivot.reduce<SumReduction>(DomainPoint::from_point<1>(Point<1>(j)), block.at(p, j));
 
-      // printf("\n (y, tx, ty) (%lf, %lf, %lf)", y, temp_x, temp_y);
-    }
-    printf("\n");
+  if((k >= rect.lo[0]) && (k <= rect.hi[0]))
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      pivot.reduce<SumReduction>(DomainPoint::from_point<1>(Point<1>(n + j)), block.at(k, j));
+}
 
-    double rhs = acc_rhs.read(DomainPoint::from_point<1>(i));
-    double z = rhs - y;
-    double x = z / target;
+void print_solution_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
 
-    // printf("\n (x = %lf, rhs = %lf, z = %lf, y = %lf, target = %lf)", x, rhs, z, y, target);
+  FieldID fid_solve = *(task->regions[0].privilege_fields.begin());
 
-    acc_solve.write(DomainPoint::from_point<1>(i), x);
-  }
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[0], fid_solve, solve_rect);
 
   printf("\n\n The Solution: \n");
-  for(i = 0; i < COL; i++)  {
-    double value = acc_solve.read(DomainPoint::from_point<1>(i));
-    printf(" %lf\n", value);
+  for(int i = solve_rect.lo[0]; i <= solve_rect.hi[0]; i++)  {
+    for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++)  {
+      double value = solve.at(i, r);
+      printf(" %lf", value);
+    }
+    printf("\n");
   }
-
 }
 
 
@@ -547,71 +931,122 @@ void trim_field_task(const Task *task,
   RegionAccessor<AccessorType::Generic, double> acc_orig =
     regions[1].get_field_accessor(fid_orig).typeify<double>();
 
-  double first_element = acc_orig.read(DomainPoint::from_point<1>(0));
+  Rect<1> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  const int rows = rect.dim_size(0);
+
+  double first_element = acc_orig.read(mat_point(0, 0));
   double current_element = 0;
   double replacement_element = 0;
-  for(int i = 1; i < ROW; i++) {
-    current_element = acc_orig.read(DomainPoint::from_point<1>(i));
+  for(int i = 1; i < rows; i++) {
+    current_element = acc_orig.read(mat_point(i, 0));
     replacement_element = current_element / first_element;
     acc_trim.write(DomainPoint::from_point<1>(i), replacement_element);
   }
 
   printf("\n Printing out the trimmed row: \n");
-  for(int i = 0; i < ROW; i++) {
+  for(int i = 0; i < rows; i++) {
     double x = acc_trim.read(DomainPoint::from_point<1>(i));
     printf("\n -> %lf", x);
   }
 }
 
+/* Fills one row block of the RHS from the generator stream of its batch */
 void generate_rhs_task(const Task *task,
             const std::vector<PhysicalRegion> &regions,
             Context ctx, HighLevelRuntime *runtime) {
-  printf("\n Inside generate_rhs_task()");
 
-  assert(regions.size() == 1);
-  assert(task->regions.size() == 1);
+  const RandomArgs args = *((const RandomArgs *) task->args);
 
   FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock rhs = get_dense_block(regions[0], fid, rect);
+
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    for(int r = rect.lo[1]; r <= rect.hi[1]; r++)
+      rhs.at(i, r) = 2 + random_entry(args, i, r, 10);
+}
 
-  RegionAccessor <AccessorType::Generic, double> acc =
-    regions[0].get_field_accessor(fid).typeify<double>();
+/* Fills one row block of the matrix from the generator */
+void init_matrix_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
 
-  Domain dom = runtime->get_index_space_domain(ctx, task->regions[0].region.get_index_space());
-  Rect<1> rect = dom.get_rect<1>();
+  const InitMatrixArgs args = *((const InitMatrixArgs *) task->args);
 
-  for(GenericPointInRectIterator<1> pir(rect); pir; pir++) {
-    acc.write(DomainPoint::from_point<1>(pir.p), 2 + rand() % 10);
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  DenseBlock block = get_matrix_block(regions[0], fid, rect);
+
+  // Along the contiguous direction of the block
+  if(block.row_stride == 1) {
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+        block.at(i, j) = random_entry(args.random, i, j, 1000);
+  } else {
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+        block.at(i, j) = random_entry(args.random, i, j, 1000);
   }
 
-  printf("\n Filled in random() values into RHS");
+  const int lo = std::max(rect.lo[0], rect.lo[1]), hi = std::min(rect.hi[0], rect.hi[1]);
+  for(int i = lo; i <= hi; i++)
+    block.at(i, i) += args.diagonal;
 }
 
 void print_lr_task(const Task *task,
             const std::vector<PhysicalRegion> &regions,
             Context ctx, HighLevelRuntime *runtime) {
 
-  int *field_id = (int *) task->args;
-
-  RegionAccessor<AccessorType::Generic, double> region_accessor[COL];
-  for(int i = 0; i < COL; i++)  {
-    region_accessor[i] = regions[0].get_field_accessor(field_id[i]).typeify<double>();
-  }
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
 
-  Domain domain = runtime->get_index_space_domain(ctx, task->regions[0].region.get_index_space());
-  Rect <1> rect = domain.get_rect<1>();
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  DenseBlock block = get_matrix_block(regions[0], fid, rect);
 
   printf("\n Printing Loaded Values:\n");
 
-  for(GenericPointInRectIterator<1> pir(rect); pir; pir++) {
-    for(int i = 0; i < COL; i++)  {
-      double x = region_accessor[i].read(DomainPoint::from_point<1>(pir.p));
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++) {
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)  {
+      double x = block.at(i, j);
       printf("  > %lf", x);
     }
     printf("\n");
   }
 }
 
+void register_elimination_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<generate_x0_task>
+            (GENERATE_X0_TASK_ID, Processor::LOC_PROC, true, true /* index */);
+
+  HighLevelRuntime::register_legion_task<trim_row_task>
+            (TRIM_ROW_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<PivotCandidate, pivot_search_task<double> >
+            (PIVOT_SEARCH_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<PivotCandidate, pivot_search_task<float> >
+            (PIVOT_SEARCH_SP_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<stage_pivot_task<double> >
+            (STAGE_PIVOT_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<stage_pivot_task<float> >
+            (STAGE_PIVOT_SP_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<eliminate_block_task<double> >
+            (ELIMINATE_BLOCK_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<eliminate_block_task<float> >
+            (ELIMINATE_BLOCK_SP_TASK_ID, Processor::LOC_PROC, true, true);
+}
+
 int main(int argc, char **argv) {
+  init_kernels(argc, argv);
+  init_matrix_layout(argc, argv);
+  register_solver_mapper(argc, argv);
+
   HighLevelRuntime::set_top_level_task_id(TOP_LEVEL_TASK_ID);
 
   HighLevelRuntime::register_legion_task<top_level_task>
@@ -621,16 +1056,21 @@ int main(int argc, char **argv) {
             (PRINT_LR_TASK_ID, Processor::LOC_PROC, true, false);
 
   HighLevelRuntime::register_legion_task<generate_rhs_task>
-            (GENERATE_RHS_TASK_ID, Processor::LOC_PROC, true, false);
+            (GENERATE_RHS_TASK_ID, Processor::LOC_PROC, true, true);
 
-  HighLevelRuntime::register_legion_task<double, generate_x0_task>
-            (GENERATE_X0_TASK_ID, Processor::LOC_PROC, true, true /* index */);
+  HighLevelRuntime::register_legion_task<init_matrix_task>
+            (INIT_MATRIX_TASK_ID, Processor::LOC_PROC, true, true);
 
-  HighLevelRuntime::register_legion_task<trim_row_task>
-            (TRIM_ROW_TASK_ID, Processor::LOC_PROC, true, true);
+  HighLevelRuntime::register_legion_task<print_solution_task>
+            (PRINT_SOLUTION_TASK_ID, Processor::LOC_PROC, true, false);
 
-  HighLevelRuntime::register_legion_task<solve_task>
-            (SOLVE_TASK_ID, Processor::LOC_PROC, true, false);
+  LinearSolver::register_tasks();
+  register_sparse_cg_tasks();
+  register_cholesky_tasks();
+  register_band_tasks();
+  register_batched_tasks();
+  register_factor_cache_tasks();
+  register_matrix_io_tasks();
 
   // HighLevelRuntime::register_legion_task<trim_rhs_task>
   //           (TRIM_RHS_TASK_ID, Processor::LOC_PROC, true, true);
@@ -0,0 +1,940 @@
+#ifndef __ARRAY_POPULATE_H__
+#define __ARRAY_POPULATE_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "legion.h"
+
+using namespace LegionRuntime::HighLevel;
+using namespace LegionRuntime::Accessor;
+using namespace LegionRuntime::Arrays;
+
+/*
+ * Diagnostics of the solver tasks. debug and spew messages are compiled
+ * out below OUTPUT_LEVEL and filtered at run time with -level solver=N, so
+ * the tasks pay nothing for them in a release build. Matrix and vector
+ * dumps are not logged: -dump runs them once as their own stage.
+ */
+extern LegionRuntime::Logger::Category log_solver;
+
+enum TASK_ID  {
+  TOP_LEVEL_TASK_ID,
+  PRINT_LR_TASK_ID,
+  GENERATE_RHS_TASK_ID,
+  GENERATE_X0_TASK_ID,
+  TRIM_ROW_TASK_ID,
+  TRIM_RHS_TASK_ID,
+  TRIM_FIELD_TASK_ID,
+  SOLVE_TASK_ID,
+  EXTRACT_PIVOT_TASK_ID,
+  FORWARD_SOLVE_TASK_ID,
+  TILE_GETRF_TASK_ID,
+  TILE_TRSM_L_TASK_ID,
+  TILE_TRSM_U_TASK_ID,
+  TILE_GEMM_TASK_ID,
+  ELIMINATE_BLOCK_TASK_ID,
+  SOLVE_BLOCK_TASK_ID,
+  UPDATE_BLOCK_TASK_ID,
+  PRINT_SOLUTION_TASK_ID,
+  PIVOT_SEARCH_TASK_ID,
+  STAGE_PIVOT_TASK_ID,
+  PERMUTE_RHS_TASK_ID,
+  SPMV_TASK_ID,
+  CG_DOT_TASK_ID,
+  CG_AXPY_TASK_ID,
+  CG_XPAY_TASK_ID,
+  PIVOT_SEARCH_SP_TASK_ID,
+  STAGE_PIVOT_SP_TASK_ID,
+  ELIMINATE_BLOCK_SP_TASK_ID,
+  SOLVE_BLOCK_SP_TASK_ID,
+  UPDATE_BLOCK_SP_TASK_ID,
+  ROUND_MATRIX_TASK_ID,
+  RESIDUAL_TASK_ID,
+  ADD_CORRECTION_TASK_ID,
+  INIT_MATRIX_TASK_ID,
+  LOAD_BLOCK_TASK_ID,
+  WRITE_BLOCK_TASK_ID,
+  CHOL_INIT_TASK_ID,
+  CHOL_PACK_TASK_ID,
+  CHOL_POTRF_TASK_ID,
+  CHOL_TRSM_TASK_ID,
+  CHOL_SYRK_TASK_ID,
+  CHOL_GEMM_TASK_ID,
+  CHOL_SOLVE_TASK_ID,
+  CHOL_UPDATE_TASK_ID,
+  CHOL_RESIDUAL_TASK_ID,
+  LOAD_BAND_TASK_ID,
+  BAND_INIT_TASK_ID,
+  BAND_GETRF_TASK_ID,
+  BAND_SOLVE_TASK_ID,
+  BAND_RESIDUAL_TASK_ID,
+  TRI_FACTOR_TASK_ID,
+  TRI_LOCAL_TASK_ID,
+  TRI_REDUCED_TASK_ID,
+  TRI_CORRECT_TASK_ID,
+  BATCH_INIT_TASK_ID,
+  BATCH_SOLVE_TASK_ID,
+  BATCH_RESIDUAL_TASK_ID,
+  HASH_ROWS_TASK_ID,
+  SAVE_FACTORS_TASK_ID,
+  LOAD_FACTORS_TASK_ID,
+  INDEX_FILE_TASK_ID,
+  LOAD_CSR_TASK_ID,
+  CG_COUNT_TASK_ID,
+  CG_FILL_TASK_ID,
+  CG_INIT_TASK_ID
+};
+
+enum FieldIDs {
+  FID_INPUT,
+  FID_RHS,
+  FID_TRIMMED_COL,
+  FID_SOLVE,
+  FID_PIVOT,
+  FID_MULT,
+  FID_PERM,
+  FID_ROW_START,
+  FID_ROW_END,
+  FID_COL_IDX,
+  FID_VALUE,
+  FID_CG_X,
+  FID_CG_R,
+  FID_CG_P,
+  FID_CG_Q,
+  FID_FACTOR,   // float copy of the matrix, factored by -precision mixed
+  FID_ORIGINAL, // copy of the matrix that -verify checks the solution against
+  FID_PACKED,   // lower triangle tiles of the -spd path, then L
+  FID_BAND,     // band storage of the -band path, then its LU factors
+  FID_SPIKE_V,  // the spikes of the partitioned tridiagonal solve
+  FID_SPIKE_W,
+  FID_BOUNDARY, // first and last unknowns of every block, same solve
+  FID_LINE_ITEM,  // the line index of a Matrix Market file (MatrixIndex)
+  FID_BLOCK_START,
+  FID_CACHE_LOAD  // factors read from the cache, until every block has them
+};
+
+/* Reduction op 0 is reserved by the runtime */
+enum ReductionOpIDs {
+  ARGMAX_REDOP_ID = 1,
+  SUM_REDOP_ID,
+  RESIDUAL_REDOP_ID
+};
+
+/*
+ * Traces of the launch sequences that repeat from one step to the next.
+ * IDs from ELIMINATION_TRACE_ID up belong to the LinearSolvers of the
+ * process: every matrix a solver factors takes the next one, and factoring
+ * the same matrix again replays its trace. An application that traces
+ * launches of its own takes IDs below it.
+ */
+enum TraceIDs {
+  ELIMINATION_TRACE_ID = 1024
+};
+
+/* A row block's pivot candidate for column k: the largest |A(row, k)| */
+struct PivotCandidate {
+  double abs_value;
+  int row;
+};
+
+/*
+ * Picks the candidate with the largest |A(row, k)|, and the smaller row on
+ * ties, so the choice does not depend on the order of the fold.
+ */
+class ArgmaxReduction {
+public:
+  typedef PivotCandidate LHS;
+  typedef PivotCandidate RHS;
+  static const PivotCandidate identity;
+
+  static bool better(const PivotCandidate &a, const PivotCandidate &b)
+  {
+    return (a.abs_value > b.abs_value) ||
+           ((a.abs_value == b.abs_value) && (a.row < b.row));
+  }
+
+  template<bool EXCLUSIVE> static void apply(LHS &lhs, RHS rhs)
+  {
+    // Only ever applied to futures, which are exclusive
+    assert(EXCLUSIVE);
+    if(better(rhs, lhs))
+      lhs = rhs;
+  }
+
+  template<bool EXCLUSIVE> static void fold(RHS &rhs1, RHS rhs2)
+  {
+    assert(EXCLUSIVE);
+    if(better(rhs2, rhs1))
+      rhs1 = rhs2;
+  }
+};
+
+class SumReduction {
+public:
+  typedef double LHS;
+  typedef double RHS;
+  static const double identity;
+
+  template<bool EXCLUSIVE> static void apply(LHS &lhs, RHS rhs)
+  {
+    if(EXCLUSIVE) {
+      lhs += rhs;
+      return;
+    }
+    // Compare and swap on the bits of the double
+    union { long long as_int; double as_double; } oldval, newval;
+    do {
+      oldval.as_double = lhs;
+      newval.as_double = oldval.as_double + rhs;
+    } while(!__sync_bool_compare_and_swap((long long *) &lhs, oldval.as_int, newval.as_int));
+  }
+
+  template<bool EXCLUSIVE> static void fold(RHS &rhs1, RHS rhs2)
+  {
+    apply<EXCLUSIVE>(rhs1, rhs2);
+  }
+};
+
+/*
+ * Squared 2-norms of r = b - A x and of b, and max |r_i|, over all RHS.
+ * The squared Frobenius norm of A and 2-norm of x are only summed when
+ * verifying the solution.
+ */
+struct ResidualNorms {
+  double r_sq;
+  double b_sq;
+  double r_max;
+  double a_sq;
+  double x_sq;
+};
+
+class ResidualReduction {
+public:
+  typedef ResidualNorms LHS;
+  typedef ResidualNorms RHS;
+  static const ResidualNorms identity;
+
+  template<bool EXCLUSIVE> static void apply(LHS &lhs, RHS rhs)
+  {
+    // Only ever applied to futures, which are exclusive
+    assert(EXCLUSIVE);
+    lhs.r_sq += rhs.r_sq;
+    lhs.b_sq += rhs.b_sq;
+    lhs.r_max = std::max(lhs.r_max, rhs.r_max);
+    lhs.a_sq += rhs.a_sq;
+    lhs.x_sq += rhs.x_sq;
+  }
+
+  template<bool EXCLUSIVE> static void fold(RHS &rhs1, RHS rhs2)
+  {
+    apply<EXCLUSIVE>(rhs1, rhs2);
+  }
+};
+
+/*
+ * Storage layout of the matrix (-layout col|row|tiled). Legion lays out 2D
+ * instances with the first coordinate fastest, so the column-major layout
+ * indexes the matrix as (row, col) and the row-major one as (col, row).
+ * The tiled layout is row-major inside every tile of the tiled LU engine,
+ * whose tasks each map their own tile; it needs -lu tiled.
+ */
+enum MatrixLayout {
+  LAYOUT_COL_MAJOR,
+  LAYOUT_ROW_MAJOR,
+  LAYOUT_TILED
+};
+
+extern MatrixLayout matrix_layout;
+
+/* Parses -layout; called from main so that every process agrees */
+void init_matrix_layout(int argc, char **argv);
+const char *matrix_layout_name(void);
+
+static inline bool matrix_transposed(void)
+{
+  return matrix_layout != LAYOUT_COL_MAJOR;
+}
+
+/*
+ * The matrix lives in a 2D index space with a single FID_INPUT field; these
+ * map matrix coordinates (row, col) to its points. The RHS and the solution
+ * are N x nrhs, point (row, rhs), whatever the layout.
+ */
+static inline Point<2> mat_index(int row, int col)
+{
+  return matrix_transposed() ? make_point(col, row) : make_point(row, col);
+}
+
+static inline DomainPoint mat_point(int row, int col)
+{
+  return DomainPoint::from_point<2>(mat_index(row, col));
+}
+
+/* Maps a (row, col) rect to the matrix index space and back */
+static inline Rect<2> mat_rect(const Rect<2> &rect)
+{
+  if(!matrix_transposed())
+    return rect;
+  return Rect<2>(make_point(rect.lo[1], rect.lo[0]), make_point(rect.hi[1], rect.hi[0]));
+}
+
+/* Bounds of a matrix region requirement in (row, col) coordinates */
+static inline Rect<2> matrix_bounds(Context ctx, HighLevelRuntime *runtime,
+                                    const RegionRequirement &req)
+{
+  return mat_rect(runtime->get_index_space_domain(ctx,
+      req.region.get_index_space()).get_rect<2>());
+}
+
+/* Wall clock time in microseconds */
+static inline double wall_time(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/*
+ * Counter-based generator for the test systems. Entry (row, col) of stream
+ * `stream` is a pure function of the seed and those three numbers, so it
+ * comes out the same whichever task generates it, in whatever order, over
+ * however many row blocks. Every input is folded in with the splitmix64
+ * finalizer.
+ */
+enum RandomStreams {
+  STREAM_MATRIX,
+  STREAM_RHS    // batch b of right hand sides is stream STREAM_RHS + b
+};
+
+struct RandomArgs {
+  unsigned long long seed;
+  int stream;
+};
+
+static inline unsigned long long random_mix(unsigned long long z)
+{
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* A value in [0, range) for entry (row, col) of the stream */
+static inline int random_entry(const RandomArgs &args, int row, int col, int range)
+{
+  unsigned long long z = random_mix(args.seed);
+  z = random_mix(z + (unsigned) args.stream);
+  z = random_mix(z + (unsigned) row);
+  z = random_mix(z + (unsigned) col);
+  return (int) (z % (unsigned) range);
+}
+
+/* array_populate.cc */
+
+/*
+ * Splits the rows of a 2D (row, col) or 1D (row) index space into disjoint,
+ * contiguous row blocks. Block b holds rows [row_lo[b], row_lo[b + 1]) and
+ * all columns. 'matrix' says the index space is the matrix, whose points
+ * follow the storage layout.
+ */
+IndexPartition create_row_blocks(Context ctx, HighLevelRuntime *runtime,
+                                 IndexSpace is, const std::vector<int> &row_lo,
+                                 bool matrix);
+
+/* The tasks of the row elimination, for LinearSolver::register_tasks */
+void register_elimination_tasks(void);
+
+/* kernels.cc */
+
+/*
+ * Dense view of a mapped 2D field of doubles (DenseBlock) or floats
+ * (FloatBlock). Element (row, col) of the mapped rect is at
+ * ptr[(row - row_lo) * row_stride + (col - col_lo) * col_stride], with
+ * strides in elements.
+ */
+template<typename T>
+struct DenseBlockOf {
+  T *ptr;
+  int row_lo, col_lo;
+  long row_stride, col_stride;
+
+  inline T &at(int row, int col) const
+  {
+    return ptr[(row - row_lo) * row_stride + (col - col_lo) * col_stride];
+  }
+};
+
+typedef DenseBlockOf<double> DenseBlock;
+typedef DenseBlockOf<float> FloatBlock;
+
+template<typename T>
+DenseBlockOf<T> get_typed_block(const PhysicalRegion &region, FieldID fid,
+                                const Rect<2> &rect);
+
+/* Same as get_typed_block for the matrix, with rect in (row, col) */
+template<typename T>
+DenseBlockOf<T> get_typed_matrix_block(const PhysicalRegion &region, FieldID fid,
+                                       const Rect<2> &rect);
+
+/* The double views */
+DenseBlock get_dense_block(const PhysicalRegion &region, FieldID fid,
+                           const Rect<2> &rect);
+DenseBlock get_matrix_block(const PhysicalRegion &region, FieldID fid,
+                            const Rect<2> &rect);
+
+/* Returns a pointer to element rect.lo of a contiguous 1D double field */
+double *get_dense_vector(const PhysicalRegion &region, FieldID fid,
+                         const Rect<1> &rect);
+
+/* Same as get_dense_vector for an int field */
+int *get_dense_index_vector(const PhysicalRegion &region, FieldID fid,
+                            const Rect<1> &rect);
+
+/* Picks the SIMD variant of the kernels for this process (-simd to override) */
+void init_kernels(int argc, char **argv);
+const char *kernel_isa_name(void);
+
+/* y += a * x and x . y, vectorized when both strides are 1 */
+void kernel_axpy(double *y, long y_stride, const double *x, long x_stride,
+                 double a, int n);
+void kernel_axpy(float *y, long y_stride, const float *x, long x_stride,
+                 float a, int n);
+double kernel_dot(const double *x, long x_stride, const double *y, long y_stride, int n);
+
+/*
+ * The matrix kernels below take double or float blocks (T = double or
+ * float). Vectors x and y are always double: a float block is only ever
+ * the factors of the mixed precision solve, whose right hand sides and
+ * corrections stay in double.
+ */
+
+/* a(row.., col..) += u v^T over a rows x cols window */
+template<typename T>
+void kernel_rank1_update(const DenseBlockOf<T> &a, int row, int col, int rows, int cols,
+                         const T *u, const T *v);
+
+/* y += alpha * a(row.., col..) x over a rows x cols window */
+template<typename T>
+void kernel_gemv(const DenseBlockOf<T> &a, int row, int col, int rows, int cols,
+                 double alpha, const double *x, double *y);
+
+/*
+ * In-place triangular solves with the m x m diagonal block of a that starts
+ * at (row, row): L unit lower triangular, U upper triangular.
+ */
+template<typename T>
+void kernel_unit_lower_solve(const DenseBlockOf<T> &a, int row, int m, double *x);
+template<typename T>
+void kernel_upper_solve(const DenseBlockOf<T> &a, int row, int m, double *x);
+
+/* tiled_lu.cc */
+
+/*
+ * Grid of tile owners (-grid PxQ, -dist cyclic|block). Owner p * cols + q
+ * holds the tiles (ti, tj) with ti mod P = p and tj mod Q = q when cyclic,
+ * or the contiguous (ti * P / #tiles, tj * Q / #tiles) block otherwise.
+ */
+struct ProcessGrid {
+  int rows, cols;
+  bool cyclic;
+};
+
+/* grid cut down so that every owner holds a tile of a num_tiles x num_tiles tiling */
+ProcessGrid fit_grid(ProcessGrid grid, int num_tiles);
+
+/* Prints the tiling tiled_lu_factor() uses and how evenly grid shares its work */
+void report_tiled_lu(int n, int tile_size, ProcessGrid grid);
+
+/* The owner of tile (ti, tj) of a num_tiles x num_tiles tiling */
+int tile_owner(const ProcessGrid &grid, int num_tiles, int ti, int tj);
+
+/*
+ * The tiles of a tiled engine as its tile tasks see them: tile (ti, tj) is
+ * tiles[ti * num_tiles + tj], a subregion of parent holding field fid, and
+ * the tasks that write it run on owners[ti * num_tiles + tj]. Tiles that
+ * an engine does not store, such as the upper triangle of Cholesky, are
+ * LogicalRegion::NO_REGION.
+ */
+struct TileMap {
+  int num_tiles;
+  LogicalRegion parent;
+  FieldID fid;
+  std::vector<LogicalRegion> tiles;
+  std::vector<int> owners;
+};
+
+/* A launcher of task_id tagged for the owner of tile (ti, tj) */
+TaskLauncher tile_launcher(const TileMap &map, TaskID task_id, const TaskArgument &arg,
+                           int ti, int tj);
+
+/* Adds tile (ti, tj) as the next region requirement of launcher */
+void add_tile(TaskLauncher &launcher, const TileMap &map, int ti, int tj,
+              PrivilegeMode privilege);
+
+/*
+ * Partitions the matrix in input_lr into tile_size x tile_size tiles over
+ * grid: one partition by owner, and one by tile of every owner's piece.
+ * The partitions last as long as the index space, so a caller that factors
+ * the same region again keeps the map rather than partitioning again.
+ */
+TileMap tile_lu_matrix(Context ctx, HighLevelRuntime *runtime,
+                       LogicalRegion input_lr, int tile_size, ProcessGrid grid);
+
+/*
+ * Factors the matrix of map in place as A = LU, with L unit lower
+ * triangular, using a right-looking tiled algorithm. Returns the future of
+ * the last tile task, which completes after all of the factorization.
+ */
+Future tiled_lu_factor(Context ctx, HighLevelRuntime *runtime, const TileMap &map);
+
+void register_tiled_lu_tasks(void);
+
+/* block_solve.cc */
+
+/*
+ * Solves A x = b for every RHS column at once, with the LU factors of A in
+ * field factor_fid of input_lr (FID_INPUT, or the float factors in
+ * FID_FACTOR) and b in rhs_lr, by blocked forward and back substitution over
+ * the row blocks of input_lp and solve_lp. perm_lr holds the row swaps of
+ * partial pivoting, perm[k] being the row swapped with row k at step k, or
+ * is NO_REGION when the factorization did not pivot. x goes to solve_lr,
+ * which must share the index space of rhs_lr. Returns without waiting for
+ * the solve, with the future of its last task.
+ */
+Future lu_solve(Context ctx, HighLevelRuntime *runtime,
+              LogicalRegion input_lr, LogicalPartition input_lp, FieldID factor_fid,
+              LogicalRegion perm_lr, LogicalRegion rhs_lr,
+              LogicalRegion solve_lr, LogicalPartition solve_lp, int num_blocks);
+
+void register_block_solve_tasks(void);
+
+/* refinement.cc */
+
+/* Rounds FID_INPUT of every row block of input_lp to float in FID_FACTOR */
+void round_matrix(Context ctx, HighLevelRuntime *runtime,
+                  LogicalRegion input_lr, LogicalPartition input_lp, int num_blocks);
+
+/*
+ * Solves A x = b with the float LU factors in FID_FACTOR and refines x in
+ * double: r = b - A x with the double A in FID_INPUT, A d = r with the float
+ * factors, x = x + d, until ||r|| / ||b|| is below tol or after max_iters
+ * corrections. rhs_ip and solve_lr are as for lu_solve, rhs_ip being the row
+ * blocks of the RHS. The refinement waits on every residual to decide
+ * whether to go on; it returns the future of the last one, which is ready.
+ */
+Future refine_solve(Context ctx, HighLevelRuntime *runtime,
+                    LogicalRegion input_lr, LogicalPartition input_lp,
+                    LogicalRegion perm_lr, LogicalRegion rhs_lr, IndexPartition rhs_ip,
+                    LogicalRegion solve_lr, LogicalPartition solve_lp, int num_blocks,
+                    double tol, int max_iters);
+
+/*
+ * Checks x in solve_lr against the matrix in field matrix_fid of input_lr,
+ * which must still hold A, and b in rhs_lr, with a single matrix-vector
+ * product over the row blocks. Prints ||b - A x||_inf and the scaled
+ * residual ||b - A x||_2 / (||A||_F ||x||_2), and returns whether the
+ * scaled residual is within 16 n eps.
+ */
+bool verify_solution(Context ctx, HighLevelRuntime *runtime,
+                     LogicalRegion input_lr, LogicalPartition input_lp, FieldID matrix_fid,
+                     LogicalRegion rhs_lr, IndexPartition rhs_ip,
+                     LogicalRegion solve_lr, int num_blocks);
+
+/* Prints the verification of an n x n system from its reduced norms */
+bool report_verification(const ResidualNorms &norms, int n, double ms);
+
+void register_refinement_tasks(void);
+
+/* linear_solver.cc */
+
+/* How a LinearSolver factors and solves */
+struct SolverOptions {
+  int num_blocks;     // row blocks of the elimination and of the solves
+  bool tiled;         // tiled LU without pivoting instead of the row elimination
+  int tile_size;      //   over tile_size x tile_size tiles
+  ProcessGrid grid;   //   owned by this grid
+  bool fused;         // one elimination launch per step instead of two
+  bool trace;         // trace the elimination steps
+  bool mixed;         // float factors refined in double; needs the fused elimination
+  double tol;         // the refinement stops when ||r|| / ||b|| < tol
+  int max_iters;      //   or after max_iters corrections
+};
+
+/*
+ * The completion of LinearSolver::factor: the future of its last launch.
+ * A default one has nothing to wait for, as for a 1 x 1 matrix, which
+ * takes no elimination step.
+ */
+class FactorFuture {
+public:
+  FactorFuture(void) : is_map(false), pending(false) {}
+  explicit FactorFuture(const Future &f) : future(f), is_map(false), pending(true) {}
+  explicit FactorFuture(const FutureMap &fm) : future_map(fm), is_map(true), pending(true) {}
+
+  void wait(void) const
+  {
+    if(!pending)
+      return;
+    if(is_map)
+      future_map.wait_all_results();
+    else
+      future.get_void_result();
+  }
+
+  Future future;        // the tiled engine: its last tile task
+  FutureMap future_map; // the row elimination: its last step
+  bool is_map;
+  bool pending;
+};
+
+/*
+ * The dense LU solver for any Legion task; the general path of
+ * top_level_task is one of its callers. register_tasks() registers every
+ * task it launches, once, before the runtime starts. factor() and solve()
+ * only issue launches and return their futures, so a caller can keep the
+ * solves of several right hand sides, or of several solvers, in flight in
+ * one runtime. A solver belongs to the task that creates it.
+ */
+class LinearSolver {
+public:
+  LinearSolver(Context ctx, HighLevelRuntime *runtime, const SolverOptions &options);
+  ~LinearSolver(void);
+
+  /*
+   * Factors the n x n matrix in FID_INPUT of a_lr in place, PA = LU, with
+   * its index space in the matrix layout. In mixed precision a_lr also
+   * needs FID_FACTOR, which gets the float factors, and A stays as is.
+   * a_lr holds the factors until the next factor().
+   */
+  FactorFuture factor(LogicalRegion a_lr);
+
+  /*
+   * x = A^-1 b for every column of FID_RHS of b_lr, into FID_SOLVE of
+   * x_lr, which shares the index space of b_lr. b_lr is only read.
+   */
+  Future solve(LogicalRegion b_lr, LogicalRegion x_lr);
+
+  /*
+   * The row blocks the solver launches over, of a matrix index space or a
+   * RHS one. Callers that fill their regions over the same blocks let
+   * each block of the solver wait on that block only.
+   */
+  IndexPartition row_blocks(IndexSpace is, bool matrix);
+
+  /*
+   * Takes a_lr as factored already, as factor() would have left it, for a
+   * caller that fills in the factors itself (the factor cache). Returns
+   * the region of the row swaps to fill in, FID_PERM over 0..n-1, or
+   * NO_REGION for the tiled engine.
+   */
+  LogicalRegion attach_factors(LogicalRegion a_lr);
+
+  /* Drops what attach_factors() took, for a caller that could not fill it */
+  void detach_factors(void);
+
+  /* The current factors: their region, row blocks, field and row swaps */
+  LogicalRegion factors(void) const { return a_lr; }
+  LogicalPartition factor_blocks(void) const { return a_lp; }
+  FieldID factor_field(void) const { return options.mixed ? FID_FACTOR : FID_INPUT; }
+  LogicalRegion permutation(void) const { return perm_lr; }
+  const SolverOptions &solver_options(void) const { return options; }
+
+  /* Row blocks of the current factors: options.num_blocks, at most n */
+  int num_row_blocks(void) const { return num_blocks; }
+
+  /* Launches issued by the last row elimination */
+  int num_launches(void) const { return launches; }
+
+  static void register_tasks(void);
+
+private:
+  void set_matrix(LogicalRegion a_lr);
+  void create_work_regions(void);
+  void release_factors(void);
+
+  Context ctx;
+  HighLevelRuntime *runtime;
+  SolverOptions options;
+  int n, num_blocks;
+  LogicalRegion a_lr;
+  LogicalPartition a_lp;
+  LogicalRegion pivot_lr, mult_lr, perm_lr;
+  TraceID trace_id;   // of the steps over these regions
+  int launches;
+  // Row blocks by index space, and the tiles of the tiled engine by
+  // matrix, until the solver destroys the space or moves on to another
+  // matrix
+  std::map<IndexSpace, IndexPartition> blocks;
+  std::map<LogicalRegion, TileMap> tile_maps;
+};
+
+/* matrix_io.cc */
+
+enum MatrixFileFormat {
+  FILE_BINARY,          // 16 byte BinaryHeader, then rows x cols doubles, row-major
+  FILE_MM_ARRAY,        // Matrix Market array real general, column-major
+  FILE_MM_COORDINATE    // Matrix Market coordinate real|integer|pattern
+};
+
+struct BinaryHeader {
+  char magic[8];        // "LLSDENSE"
+  int rows, cols;
+};
+
+/*
+ * A matrix file as described by its header, which the top-level task reads
+ * once; the load tasks get it by value and map the data themselves.
+ */
+struct MatrixFile {
+  char path[256];
+  MatrixFileFormat format;
+  bool symmetric;       // coordinate only: (i, j) also stands for (j, i)
+  bool pattern;         // coordinate only: no values, every entry is 1
+  int rows, cols;
+  long long entries;
+  long long data_offset;  // bytes before the first entry
+};
+
+/* Reads the header of path; prints why and returns false if it cannot */
+bool open_matrix_file(const char *path, MatrixFile &file);
+
+/*
+ * Band storage of an n x n matrix with kl subdiagonals and ku
+ * superdiagonals (-band). A(i, j) is at (j - i + kl, i) of a (diagonal,
+ * row) region, so the diagonals of a row are contiguous. The kl diagonals
+ * above the ku stored ones start at zero and take the fill-in of the row
+ * swaps of the banded LU.
+ */
+struct BandShape {
+  int n, kl, ku;
+};
+
+static inline int band_diagonals(const BandShape &shape)
+{
+  return 2 * shape.kl + shape.ku + 1;
+}
+
+/* A block of band rows, indexed by (row, col) of the matrix */
+struct BandView {
+  DenseBlock block;
+  int kl;
+
+  inline double &at(int i, int j) const
+  {
+    return block.at(j - i + kl, i);
+  }
+};
+
+/*
+ * Scans the whole file for the lowest and highest nonzero diagonals; kl
+ * and ku come back as the number of nonzero sub- and superdiagonals.
+ */
+bool detect_bandwidth(const MatrixFile &file, int &kl, int &ku);
+
+/*
+ * Line index of a Matrix Market file over row blocks, built by one task in
+ * one pass, so that each block of a load parses only the lines of its own
+ * rows. row_lo is the first row of every block and the row count after
+ * the last, as for create_row_blocks. done is true once the file has been
+ * indexed, false if it could not be read.
+ */
+struct MatrixIndex {
+  LogicalRegion items_lr;   // FID_LINE_ITEM, the line items of every block in turn
+  LogicalRegion starts_lr;  // FID_BLOCK_START, where each block's items start
+  Future done;
+};
+
+MatrixIndex index_matrix_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                              const std::vector<int> &row_lo);
+
+/* Gives every point of launcher the whole index, as its next two regions and a future */
+void add_matrix_index(IndexLauncher &launcher, const MatrixIndex &index);
+
+void destroy_matrix_index(Context ctx, HighLevelRuntime *runtime, const MatrixIndex &index);
+
+/* Entries per block of an index of a coordinate file; waits for the index */
+std::vector<long long> matrix_index_counts(Context ctx, HighLevelRuntime *runtime,
+                                           const MatrixIndex &index);
+
+/*
+ * Fills the CSR regions of the sparse path (FID_ROW_START and FID_ROW_END
+ * of rows_lr, FID_COL_IDX and FID_VALUE of nz_lr) from a coordinate file,
+ * one task per row block. Block b of nz_lp must hold as many points as
+ * block b of the index has entries. Every block returns whether it could
+ * read its rows, as for file_blocks_loaded.
+ */
+FutureMap load_csr_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                        const MatrixIndex &index, LogicalRegion rows_lr, LogicalPartition rows_lp,
+                        LogicalRegion nz_lr, LogicalPartition nz_lp, int num_blocks);
+
+/*
+ * Fills field fid of every row block of the band region lr from the file,
+ * one task per block, like load_matrix_file. Nonzeros outside the band of
+ * shape are dropped with a warning.
+ */
+FutureMap load_band_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                         const BandShape &shape, LogicalRegion lr, LogicalPartition lp,
+                         FieldID fid, int num_blocks);
+
+/*
+ * Fills field fid of every row block of lp from the file, one task per
+ * block. matrix says whether lr is the matrix, indexed through mat_rect,
+ * or a (row, rhs) region. The future map completes with the last block,
+ * and every block returns whether it could read its rows.
+ */
+FutureMap load_matrix_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                           LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                           bool matrix, int num_blocks);
+
+/*
+ * Waits for the blocks of load_matrix_file or load_band_file; false if the
+ * file could not be read by any of them, which each logs.
+ */
+bool file_blocks_loaded(const FutureMap &fm, int num_blocks);
+
+/*
+ * Writes field fid of the (row, rhs) region lr to path, as a Matrix Market
+ * array if path ends in .mtx and in the binary format otherwise. Every row
+ * block of lp writes its own rows.
+ */
+void write_solution_file(Context ctx, HighLevelRuntime *runtime, const char *path,
+                         LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                         int num_blocks);
+
+void register_matrix_io_tasks(void);
+
+/* solver_mapper.cc */
+
+/*
+ * A single task tagged owner_tag(color) runs on the processor that owns
+ * row block or tile color, the one that every index launch over the row
+ * blocks also sends point color to.
+ */
+enum {
+  OWNER_TAG = 1 << 24,
+  OWNER_COLOR_MASK = OWNER_TAG - 1
+};
+
+static inline MappingTagID owner_tag(int color)
+{
+  return OWNER_TAG | (MappingTagID) color;
+}
+
+/* Installs the solver mapper on every processor, unless -mapper default */
+void register_solver_mapper(int argc, char **argv);
+const char *solver_mapper_name(void);
+
+/* sparse_cg.cc */
+
+/*
+ * Builds a sparse SPD matrix in CSR regions split into the row blocks of
+ * row_lo, either the test stencil or, when matrix_file is not NULL, a
+ * coordinate Matrix Market file. Solves it with conjugate gradient until
+ * ||r|| / ||b|| is below tol or after max_iters iterations.
+ */
+void sparse_cg_solve(Context ctx, HighLevelRuntime *runtime, int n,
+                     const MatrixFile *matrix_file, const std::vector<int> &row_lo,
+                     double tol, int max_iters, bool dump);
+
+void register_sparse_cg_tasks(void);
+
+/* cholesky.cc */
+
+/*
+ * SPD path (-spd): A = L L^T with a tiled Cholesky factorization over the
+ * tiles of the lower triangle only, packed tile by tile, then num_batches
+ * batches of nrhs right hand sides solved with L and L^T. A comes from the
+ * generator, symmetric and diagonally dominant, or from matrix_file, whose
+ * lower triangle is used. rhs_file, out_path and verify are as for the
+ * general path.
+ */
+void cholesky_solve(Context ctx, HighLevelRuntime *runtime, int n, int nrhs,
+                    int num_batches, int tile_size, ProcessGrid grid,
+                    unsigned long long seed, const MatrixFile *matrix_file,
+                    const MatrixFile *rhs_file, const char *out_path, bool verify);
+
+void register_cholesky_tasks(void);
+
+/* band.cc */
+
+/*
+ * Band path (-band): A has kl subdiagonals and ku superdiagonals and is
+ * stored as its band only. Tridiagonal systems (kl, ku <= 1) are solved by
+ * a partitioned solve over num_blocks row blocks, which needs A to be
+ * diagonally dominant; wider bands by a banded LU with partial pivoting.
+ * A comes from the generator, with kl = ku, or from matrix_file; the other
+ * arguments are as for the SPD path.
+ */
+void band_solve(Context ctx, HighLevelRuntime *runtime, int n, int kl, int ku, int nrhs,
+                int num_batches, int num_blocks, unsigned long long seed,
+                const MatrixFile *matrix_file, const MatrixFile *rhs_file,
+                const char *out_path, bool verify);
+
+void register_band_tasks(void);
+
+/* batched.cc */
+
+/*
+ * Batched path (-small N): num_batches batches of num_systems independent
+ * N x N systems, generated diagonally dominant, each batch solved by one
+ * index launch over num_blocks ranges of systems. verify checks the
+ * systems of the last batch.
+ */
+void batched_solve(Context ctx, HighLevelRuntime *runtime, int n, int num_systems,
+                   int num_batches, int num_blocks, unsigned long long seed, bool verify);
+
+void register_batched_tasks(void);
+
+/* factor_cache.cc */
+
+/*
+ * Hash of the entries of the n x n matrix in field fid of lr, computed by
+ * the num_blocks row blocks of lp. It does not depend on the layout of the
+ * matrix or on its blocks.
+ */
+unsigned long long matrix_content_hash(Context ctx, HighLevelRuntime *runtime,
+                                       LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                                       int num_blocks);
+
+/*
+ * The file in dir that caches the factors of the matrix with that hash,
+ * as options factor it, into path; prints why and returns false if the
+ * path does not fit in size.
+ */
+bool factor_cache_path(const char *dir, unsigned long long hash,
+                       const SolverOptions &options, char *path, size_t size);
+
+/*
+ * Loads the factors in path into a_lr and attaches them to solver, as if
+ * solver.factor(a_lr) had computed them, and waits for the blocks to read
+ * them. Returns
+ * false, and leaves a_lr and the solver without factors, if path does not
+ * exist, holds the factors of another matrix or engine, or cannot be read.
+ */
+bool load_factor_cache(Context ctx, HighLevelRuntime *runtime, const char *path,
+                       unsigned long long hash, LinearSolver &solver, LogicalRegion a_lr);
+
+/*
+ * Writes the factors of the last solver.factor() to path, for the matrix
+ * with that hash, and waits for them; false if any block failed.
+ */
+bool save_factor_cache(Context ctx, HighLevelRuntime *runtime, const char *path,
+                       unsigned long long hash, LinearSolver &solver);
+
+void register_factor_cache_tasks(void);
+
+#endif // __ARRAY_POPULATE_H__
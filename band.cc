@@ -0,0 +1,751 @@
+#include "array_populate.h"
+
+/*
+ * Banded systems (-band): only the diagonals of the band are stored, in the
+ * (diagonal, row) layout of BandShape, so memory and work grow with n times
+ * the bandwidth instead of n^2.
+ *
+ * General band
+ *   LU with partial pivoting in the band storage, like LAPACK gbtf2: the
+ *   pivot of column k is searched in rows k..k+kl, and a row swap can fill
+ *   at most kl diagonals above the ku stored ones. Pivoting makes every
+ *   column depend on the one before, so the factorization and the solves
+ *   are single tasks; the loads, the generator and the residual run over
+ *   the row blocks.
+ *
+ * Tridiagonal (kl, ku <= 1)
+ *   A partitioned (SPIKE) solve as index launches over P row blocks. Block
+ *   p factors its own diagonal block A_p without pivoting and solves for
+ *   its two spikes, the columns that couple it to its neighbours:
+ *
+ *     V_p = A_p^-1 A(hi, hi + 1) e_hi      W_p = A_p^-1 A(lo, lo - 1) e_lo
+ *
+ *   so that x_p = g_p - V_p x(hi + 1) - W_p x(lo - 1), with g_p = A_p^-1 b_p.
+ *   Taken at the first and the last row of every block, these are a 2P x 2P
+ *   system in the boundary unknowns t_p = x(lo), u_p = x(hi), with bandwidth
+ *   2, which the top-level task factors and one task solves. Every block
+ *   then corrects g_p with its neighbours' boundary values. Without
+ *   pivoting in the blocks, this needs A to be diagonally dominant, as the
+ *   generated matrices are.
+ */
+
+/* Arguments of every task below */
+struct BandArgs {
+  BandShape shape;
+  RandomArgs random;  // BAND_INIT only
+};
+
+/* The spikes at the first and the last row of a block, from TRI_FACTOR */
+struct SpikeEnds {
+  double v_lo, v_hi, w_lo, w_hi;
+};
+
+/* The band rows mapped by requirement idx; rect is (diagonal, row) */
+static BandView map_band(Context ctx, HighLevelRuntime *runtime, const Task *task,
+                         const std::vector<PhysicalRegion> &regions, int idx,
+                         const BandShape &shape, Rect<2> &rect)
+{
+  FieldID fid = *(task->regions[idx].privilege_fields.begin());
+  rect = runtime->get_index_space_domain(ctx,
+      task->regions[idx].region.get_index_space()).get_rect<2>();
+  BandView view;
+  view.block = get_dense_block(regions[idx], fid, rect);
+  view.kl = shape.kl;
+  return view;
+}
+
+/* Band storage of the top-level task, for the reduced system */
+static BandView host_band(std::vector<double> &storage, const BandShape &shape)
+{
+  storage.assign((size_t) shape.n * band_diagonals(shape), 0.0);
+  BandView view;
+  view.block.ptr = &storage[0];
+  view.block.row_lo = view.block.col_lo = 0;
+  view.block.row_stride = 1;
+  view.block.col_stride = band_diagonals(shape);
+  view.kl = shape.kl;
+  return view;
+}
+
+/*
+ * LU with partial pivoting in place: L below the diagonal without its unit
+ * diagonal, U on and above it. Row k was swapped with row piv[k] before
+ * column k was eliminated. Returns the first zero pivot, or -1.
+ */
+static int band_factor(const BandView &ab, const BandShape &shape, int *piv)
+{
+  const int n = shape.n;
+  int singular = -1;
+
+  for(int k = 0; k < n; k++) {
+    const int last = std::min(n - 1, k + shape.kl);
+    const int ucol = std::min(n - 1, k + shape.kl + shape.ku);
+
+    int p = k;
+    for(int i = k + 1; i <= last; i++)
+      if(fabs(ab.at(i, k)) > fabs(ab.at(p, k)))
+        p = i;
+    piv[k] = p;
+
+    if(ab.at(p, k) == 0) {
+      if(singular < 0)
+        singular = k;
+      continue;
+    }
+    if(p != k)
+      for(int j = k; j <= ucol; j++)
+        std::swap(ab.at(k, j), ab.at(p, j));
+
+    const double pivot = ab.at(k, k);
+    for(int i = k + 1; i <= last; i++) {
+      const double m = ab.at(i, k) / pivot;
+      ab.at(i, k) = m;
+      for(int j = k + 1; j <= ucol; j++)
+        ab.at(i, j) -= m * ab.at(k, j);
+    }
+  }
+  return singular;
+}
+
+/* x = A^-1 x with the factors of band_factor */
+static void band_solve_vector(const BandView &ab, const BandShape &shape, const int *piv,
+                              double *x)
+{
+  const int n = shape.n;
+
+  // The swaps only moved the columns to the right of k, so they are
+  // applied in the order of the elimination
+  for(int k = 0; k < n; k++) {
+    if(piv[k] != k)
+      std::swap(x[k], x[piv[k]]);
+    const int last = std::min(n - 1, k + shape.kl);
+    for(int i = k + 1; i <= last; i++)
+      x[i] -= ab.at(i, k) * x[k];
+  }
+
+  for(int i = n - 1; i >= 0; i--) {
+    const int ucol = std::min(n - 1, i + shape.kl + shape.ku);
+    double s = x[i];
+    for(int j = i + 1; j <= ucol; j++)
+      s -= ab.at(i, j) * x[j];
+    x[i] = s / ab.at(i, i);
+  }
+}
+
+/* y = A_p^-1 y over rows [lo, hi], with the factors of TRI_FACTOR */
+static void tri_block_solve(const BandView &a, int lo, int hi, double *y)
+{
+  for(int i = lo + 1; i <= hi; i++)
+    y[i - lo] -= a.at(i, i - 1) * y[i - lo - 1];
+  y[hi - lo] /= a.at(hi, hi);
+  for(int i = hi - 1; i >= lo; i--)
+    y[i - lo] = (y[i - lo] - a.at(i, i + 1) * y[i - lo + 1]) / a.at(i, i);
+}
+
+/* Generates the rows of a block: |i - j| <= kl, diagonally dominant */
+void band_init_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  const BandShape &shape = args.shape;
+  Rect<2> rect;
+  BandView a = map_band(ctx, runtime, task, regions, 0, shape, rect);
+
+  // Entries in [0, 1), and the diagonal above the sum of the others
+  for(int i = rect.lo[1]; i <= rect.hi[1]; i++) {
+    for(int d = rect.lo[0]; d <= rect.hi[0]; d++)
+      a.block.at(d, i) = 0;
+    const int lo = std::max(0, i - shape.kl), hi = std::min(shape.n - 1, i + shape.ku);
+    for(int j = lo; j <= hi; j++)
+      a.at(i, j) = random_entry(args.random, i, j, 1000) * 1e-3 +
+                   ((i == j) ? (shape.kl + shape.ku + 1) : 0);
+  }
+}
+
+void band_getrf_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  Rect<2> rect;
+  BandView ab = map_band(ctx, runtime, task, regions, 0, args.shape, rect);
+
+  FieldID fid_perm = *(task->regions[1].privilege_fields.begin());
+  Rect<1> perm_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  int *piv = get_dense_index_vector(regions[1], fid_perm, perm_rect);
+
+  const int singular = band_factor(ab, args.shape, piv);
+  if(singular >= 0)
+    log_solver.warning("band matrix is singular: column %d has no pivot", singular);
+}
+
+void band_solve_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  Rect<2> rect;
+  BandView ab = map_band(ctx, runtime, task, regions, 0, args.shape, rect);
+
+  FieldID fid_perm = *(task->regions[1].privilege_fields.begin());
+  Rect<1> perm_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  const int *piv = get_dense_index_vector(regions[1], fid_perm, perm_rect);
+
+  FieldID fid_solve = *(task->regions[2].privilege_fields.begin());
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[2], fid_solve, solve_rect);
+
+  std::vector<double> x(args.shape.n);
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    for(int i = 0; i < args.shape.n; i++)
+      x[i] = solve.at(i, r);
+    band_solve_vector(ab, args.shape, piv, &x[0]);
+    for(int i = 0; i < args.shape.n; i++)
+      solve.at(i, r) = x[i];
+  }
+}
+
+/* Factors A_p and solves for its spikes; returns their ends */
+SpikeEnds tri_factor_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  Rect<2> rect;
+  BandView a = map_band(ctx, runtime, task, regions, 0, args.shape, rect);
+  const int lo = rect.lo[1], hi = rect.hi[1];
+
+  Rect<2> spike_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  DenseBlock v = get_dense_block(regions[1], FID_SPIKE_V, spike_rect);
+  DenseBlock w = get_dense_block(regions[1], FID_SPIKE_W, spike_rect);
+
+  // A(lo, lo - 1) and A(hi, hi + 1) couple the block to its neighbours and
+  // are left in place for the spikes
+  for(int i = lo + 1; i <= hi; i++) {
+    if(a.at(i - 1, i - 1) == 0) {
+      log_solver.warning("tridiagonal block %d..%d needs pivoting at row %d", lo, hi, i - 1);
+      break;
+    }
+    const double l = a.at(i, i - 1) / a.at(i - 1, i - 1);
+    a.at(i, i - 1) = l;
+    a.at(i, i) -= l * a.at(i - 1, i);
+  }
+
+  std::vector<double> vs(hi - lo + 1, 0.0), ws(hi - lo + 1, 0.0);
+  vs[hi - lo] = a.at(hi, hi + 1);
+  ws[0] = a.at(lo, lo - 1);
+  tri_block_solve(a, lo, hi, &vs[0]);
+  tri_block_solve(a, lo, hi, &ws[0]);
+  for(int i = lo; i <= hi; i++) {
+    v.at(i, spike_rect.lo[1]) = vs[i - lo];
+    w.at(i, spike_rect.lo[1]) = ws[i - lo];
+  }
+
+  SpikeEnds ends = { vs[0], vs[hi - lo], ws[0], ws[hi - lo] };
+  return ends;
+}
+
+/* g_p = A_p^-1 b_p in place, and its ends to rows 2p and 2p + 1 of the boundary */
+void tri_local_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  Rect<2> rect;
+  BandView a = map_band(ctx, runtime, task, regions, 0, args.shape, rect);
+  const int lo = rect.lo[1], hi = rect.hi[1];
+
+  FieldID fid_solve = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_boundary = *(task->regions[2].privilege_fields.begin());
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> boundary_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[1], fid_solve, solve_rect);
+  DenseBlock boundary = get_dense_block(regions[2], fid_boundary, boundary_rect);
+
+  std::vector<double> g(hi - lo + 1);
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    for(int i = lo; i <= hi; i++)
+      g[i - lo] = solve.at(i, r);
+    tri_block_solve(a, lo, hi, &g[0]);
+    for(int i = lo; i <= hi; i++)
+      solve.at(i, r) = g[i - lo];
+    boundary.at(boundary_rect.lo[0], r) = g[0];
+    boundary.at(boundary_rect.lo[0] + 1, r) = g[hi - lo];
+  }
+}
+
+/*
+ * Solves the reduced system in place. The argument holds its band factors,
+ * then its pivots, then its shape.
+ */
+void tri_reduced_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const char *buffer = (const char *) task->args;
+  const BandShape shape = *((const BandShape *) (buffer + task->arglen - sizeof(BandShape)));
+  const int m = shape.n;
+  const int *piv = (const int *) (buffer + (size_t) m * band_diagonals(shape) * sizeof(double));
+
+  BandView ab;
+  ab.block.ptr = (double *) buffer;
+  ab.block.row_lo = ab.block.col_lo = 0;
+  ab.block.row_stride = 1;
+  ab.block.col_stride = band_diagonals(shape);
+  ab.kl = shape.kl;
+
+  FieldID fid_boundary = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock boundary = get_dense_block(regions[0], fid_boundary, rect);
+
+  std::vector<double> z(m);
+  for(int r = rect.lo[1]; r <= rect.hi[1]; r++) {
+    for(int i = 0; i < m; i++)
+      z[i] = boundary.at(i, r);
+    band_solve_vector(ab, shape, piv, &z[0]);
+    for(int i = 0; i < m; i++)
+      boundary.at(i, r) = z[i];
+  }
+}
+
+/* x_p = g_p - V_p t_(p+1) - W_p u_(p-1) */
+void tri_correct_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const int p = task->index_point.point_data[0];
+
+  Rect<2> spike_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock v = get_dense_block(regions[0], FID_SPIKE_V, spike_rect);
+  DenseBlock w = get_dense_block(regions[0], FID_SPIKE_W, spike_rect);
+
+  FieldID fid_boundary = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_solve = *(task->regions[2].privilege_fields.begin());
+  Rect<2> boundary_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock boundary = get_dense_block(regions[1], fid_boundary, boundary_rect);
+  DenseBlock solve = get_dense_block(regions[2], fid_solve, solve_rect);
+  const int num_blocks = boundary_rect.dim_size(0) / 2;
+
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    const double t_next = (p < num_blocks - 1) ? boundary.at(2 * p + 2, r) : 0;
+    const double u_prev = (p > 0) ? boundary.at(2 * p - 1, r) : 0;
+    for(int i = solve_rect.lo[0]; i <= solve_rect.hi[0]; i++)
+      solve.at(i, r) -= v.at(i, spike_rect.lo[1]) * t_next +
+                        w.at(i, spike_rect.lo[1]) * u_prev;
+  }
+}
+
+/* r = b - A x over the rows of a block, with the norms of -verify */
+ResidualNorms band_residual_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BandArgs args = *((const BandArgs *) task->args);
+  const BandShape &shape = args.shape;
+  Rect<2> rect;
+  BandView a = map_band(ctx, runtime, task, regions, 0, shape, rect);
+
+  FieldID fid_x = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[2].privilege_fields.begin());
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> b_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock xb = get_dense_block(regions[1], fid_x, x_rect);
+  DenseBlock bb = get_dense_block(regions[2], fid_b, b_rect);
+
+  ResidualNorms norms = ResidualReduction::identity;
+  for(int c = b_rect.lo[1]; c <= b_rect.hi[1]; c++) {
+    for(int i = b_rect.lo[0]; i <= b_rect.hi[0]; i++) {
+      const int lo = std::max(0, i - shape.kl), hi = std::min(shape.n - 1, i + shape.ku);
+      double r = bb.at(i, c);
+      for(int j = lo; j <= hi; j++) {
+        r -= a.at(i, j) * xb.at(j, c);
+        if(c == b_rect.lo[1])
+          norms.a_sq += a.at(i, j) * a.at(i, j);
+      }
+      norms.r_sq += r * r;
+      norms.b_sq += bb.at(i, c) * bb.at(i, c);
+      norms.x_sq += xb.at(i, c) * xb.at(i, c);
+      norms.r_max = std::max(norms.r_max, fabs(r));
+    }
+  }
+  return norms;
+}
+
+/* Row blocks of the (diagonal, row) band region, all diagonals each */
+static IndexPartition create_band_blocks(Context ctx, HighLevelRuntime *runtime,
+                                         IndexSpace band_is, int width,
+                                         const std::vector<int> &row_lo)
+{
+  const int num_blocks = row_lo.size() - 1;
+  DomainColoring coloring;
+  for(int b = 0; b < num_blocks; b++) {
+    Rect<2> block(make_point(0, row_lo[b]), make_point(width - 1, row_lo[b + 1] - 1));
+    coloring[b] = Domain::from_rect<2>(block);
+  }
+  Rect<1> color_rect(Point<1>(0), Point<1>(num_blocks - 1));
+  return runtime->create_index_partition(ctx, band_is,
+      Domain::from_rect<1>(color_rect), coloring, true /* disjoint */);
+}
+
+void band_solve(Context ctx, HighLevelRuntime *runtime, int n, int kl, int ku, int nrhs,
+                int num_batches, int num_blocks, unsigned long long seed,
+                const MatrixFile *matrix_file, const MatrixFile *rhs_file,
+                const char *out_path, bool verify)
+{
+  // A bidiagonal matrix goes through the tridiagonal solve too
+  const bool tridiagonal = (kl <= 1) && (ku <= 1);
+  BandArgs args;
+  args.shape.n = n;
+  args.shape.kl = tridiagonal ? 1 : kl;
+  args.shape.ku = tridiagonal ? 1 : ku;
+  args.random.seed = seed;
+  args.random.stream = STREAM_MATRIX;
+  const BandShape &shape = args.shape;
+  const int width = band_diagonals(shape);
+
+  // Every block of the partitioned solve needs a first and a last row
+  if(tridiagonal)
+    num_blocks = std::min(num_blocks, n / 2);
+  num_blocks = std::max(1, std::min(num_blocks, n));
+  std::vector<int> row_lo(num_blocks + 1);
+  for(int b = 0; b <= num_blocks; b++)
+    row_lo[b] = (int) (((long long) n * b) / num_blocks);
+
+  printf("\n Solving %d x %d band system (kl = %d, ku = %d) with %d batch(es) of %d right hand side(s):"
+         " %s over %d row blocks (%s mapper)",
+         n, n, kl, ku, num_batches, nrhs,
+         tridiagonal ? "partitioned tridiagonal solve" : "banded LU", num_blocks,
+         solver_mapper_name());
+  printf("\n Band storage: %.1f MB for %d diagonals, against %.1f MB for the whole matrix",
+         (double) n * width * sizeof(double) / 1048576.0, width,
+         (double) n * n * sizeof(double) / 1048576.0);
+
+  Rect<2> band_rect(make_point(0, 0), make_point(width - 1, n - 1));
+  IndexSpace band_is = runtime->create_index_space(ctx, Domain::from_rect<2>(band_rect));
+  FieldSpace band_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, band_fs);
+    allocator.allocate_field(sizeof(double), FID_BAND);
+    if(verify)
+      allocator.allocate_field(sizeof(double), FID_ORIGINAL);
+  }
+  LogicalRegion band_lr = runtime->create_logical_region(ctx, band_is, band_fs);
+  IndexPartition band_ip = create_band_blocks(ctx, runtime, band_is, width, row_lo);
+  LogicalPartition band_lp = runtime->get_logical_partition(ctx, band_lr, band_ip);
+
+  Rect<1> block_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain block_domain = Domain::from_rect<1>(block_bounds);
+
+  // General band: the pivots. Tridiagonal: the spikes, and the boundary
+  // unknowns of the reduced system.
+  IndexSpace perm_is = IndexSpace::NO_SPACE, spike_is = IndexSpace::NO_SPACE,
+             boundary_is = IndexSpace::NO_SPACE;
+  FieldSpace aux_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, aux_fs);
+    if(tridiagonal) {
+      allocator.allocate_field(sizeof(double), FID_SPIKE_V);
+      allocator.allocate_field(sizeof(double), FID_SPIKE_W);
+    } else
+      allocator.allocate_field(sizeof(int), FID_PERM);
+  }
+  FieldSpace boundary_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, boundary_fs);
+    allocator.allocate_field(sizeof(double), FID_BOUNDARY);
+  }
+  LogicalRegion perm_lr = LogicalRegion::NO_REGION, spike_lr = LogicalRegion::NO_REGION,
+                boundary_lr = LogicalRegion::NO_REGION;
+  LogicalPartition spike_lp, boundary_lp;
+  std::vector<char> reduced_args;
+
+  Rect<2> rhs_rect(make_point(0, 0), make_point(n - 1, nrhs - 1));
+  IndexSpace rhs_is = runtime->create_index_space(ctx, Domain::from_rect<2>(rhs_rect));
+  FieldSpace rhs_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, rhs_fs);
+    allocator.allocate_field(sizeof(double), FID_RHS);
+  }
+  FieldSpace solve_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, solve_fs);
+    allocator.allocate_field(sizeof(double), FID_SOLVE);
+  }
+  LogicalRegion rhs_lr = runtime->create_logical_region(ctx, rhs_is, rhs_fs);
+  LogicalRegion solve_lr = runtime->create_logical_region(ctx, rhs_is, solve_fs);
+  IndexPartition rhs_ip = create_row_blocks(ctx, runtime, rhs_is, row_lo, false);
+  LogicalPartition rhs_lp = runtime->get_logical_partition(ctx, rhs_lr, rhs_ip);
+  LogicalPartition solve_lp = runtime->get_logical_partition(ctx, solve_lr, rhs_ip);
+
+  // Both inputs are read before anything is factored; a file that fails
+  // skips to the cleanup
+  bool loaded = true;
+  double ts_generate = wall_time();
+  if(matrix_file != NULL) {
+    loaded = file_blocks_loaded(load_band_file(ctx, runtime, *matrix_file, shape, band_lr,
+                                               band_lp, FID_BAND, num_blocks), num_blocks);
+    if(!loaded)
+      printf("\n Loading %s failed\n", matrix_file->path);
+  } else {
+    IndexLauncher init_launcher(BAND_INIT_TASK_ID, block_domain,
+      TaskArgument(&args, sizeof(args)), ArgumentMap());
+    init_launcher.add_region_requirement(
+      RegionRequirement(band_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, band_lr));
+    init_launcher.add_field(0, FID_BAND);
+    runtime->execute_index_space(ctx, init_launcher).wait_all_results();
+  }
+  // Every batch solves the RHS of the file
+  if(loaded && (rhs_file != NULL)) {
+    loaded = file_blocks_loaded(load_matrix_file(ctx, runtime, *rhs_file, rhs_lr, rhs_lp, FID_RHS,
+                                                 false /* matrix */, num_blocks), num_blocks);
+    if(!loaded)
+      printf("\n Loading %s failed\n", rhs_file->path);
+  }
+
+  if(loaded) {
+    printf("\n Matrix %s: %.3f ms\n", (matrix_file != NULL) ? "loaded" : "generated",
+           (wall_time() - ts_generate) * 1e-3);
+
+    // The factorization overwrites the band with its factors
+    if(verify) {
+      CopyLauncher save_launcher;
+      save_launcher.add_copy_requirements(
+        RegionRequirement(band_lr, READ_ONLY, EXCLUSIVE, band_lr),
+        RegionRequirement(band_lr, WRITE_DISCARD, EXCLUSIVE, band_lr));
+      save_launcher.add_src_field(0, FID_BAND);
+      save_launcher.add_dst_field(0, FID_ORIGINAL);
+      runtime->issue_copy_operation(ctx, save_launcher);
+    }
+
+    double ts_start = wall_time();
+    if(!tridiagonal) {
+      Rect<1> perm_rect(Point<1>(0), Point<1>(n - 1));
+      perm_is = runtime->create_index_space(ctx, Domain::from_rect<1>(perm_rect));
+      perm_lr = runtime->create_logical_region(ctx, perm_is, aux_fs);
+
+      TaskLauncher getrf_launcher(BAND_GETRF_TASK_ID, TaskArgument(&args, sizeof(args)));
+      getrf_launcher.add_region_requirement(
+        RegionRequirement(band_lr, READ_WRITE, EXCLUSIVE, band_lr));
+      getrf_launcher.add_field(0, FID_BAND);
+      getrf_launcher.add_region_requirement(
+        RegionRequirement(perm_lr, WRITE_DISCARD, EXCLUSIVE, perm_lr));
+      getrf_launcher.add_field(1, FID_PERM);
+      runtime->execute_task(ctx, getrf_launcher).get_void_result();
+    } else {
+      Rect<2> spike_rect(make_point(0, 0), make_point(n - 1, 0));
+      spike_is = runtime->create_index_space(ctx, Domain::from_rect<2>(spike_rect));
+      spike_lr = runtime->create_logical_region(ctx, spike_is, aux_fs);
+      IndexPartition spike_ip = create_row_blocks(ctx, runtime, spike_is, row_lo, false);
+      spike_lp = runtime->get_logical_partition(ctx, spike_lr, spike_ip);
+
+      Rect<2> boundary_rect(make_point(0, 0), make_point(2 * num_blocks - 1, nrhs - 1));
+      boundary_is = runtime->create_index_space(ctx, Domain::from_rect<2>(boundary_rect));
+      boundary_lr = runtime->create_logical_region(ctx, boundary_is, boundary_fs);
+      std::vector<int> boundary_lo(num_blocks + 1);
+      for(int b = 0; b <= num_blocks; b++)
+        boundary_lo[b] = 2 * b;
+      IndexPartition boundary_ip = create_row_blocks(ctx, runtime, boundary_is, boundary_lo, false);
+      boundary_lp = runtime->get_logical_partition(ctx, boundary_lr, boundary_ip);
+
+      IndexLauncher factor_launcher(TRI_FACTOR_TASK_ID, block_domain,
+        TaskArgument(&args, sizeof(args)), ArgumentMap());
+      factor_launcher.add_region_requirement(
+        RegionRequirement(band_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, band_lr));
+      factor_launcher.add_field(0, FID_BAND);
+      factor_launcher.add_region_requirement(
+        RegionRequirement(spike_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, spike_lr));
+      factor_launcher.add_field(1, FID_SPIKE_V);
+      factor_launcher.add_field(1, FID_SPIKE_W);
+      FutureMap ends_fm = runtime->execute_index_space(ctx, factor_launcher);
+
+      // Unknowns t_p = x(lo) and u_p = x(hi) of block p are 2p and 2p + 1:
+      //   t_p + W_p(lo) u_(p-1) + V_p(lo) t_(p+1) = g_p(lo)
+      //   u_p + W_p(hi) u_(p-1) + V_p(hi) t_(p+1) = g_p(hi)
+      BandShape reduced = { 2 * num_blocks, 2, 2 };
+      std::vector<double> reduced_storage;
+      BandView s = host_band(reduced_storage, reduced);
+      for(int p = 0; p < num_blocks; p++) {
+        SpikeEnds ends = ends_fm.get_result<SpikeEnds>(DomainPoint::from_point<1>(Point<1>(p)));
+        s.at(2 * p, 2 * p) = 1;
+        s.at(2 * p + 1, 2 * p + 1) = 1;
+        if(p > 0) {
+          s.at(2 * p, 2 * p - 1) = ends.w_lo;
+          s.at(2 * p + 1, 2 * p - 1) = ends.w_hi;
+        }
+        if(p < num_blocks - 1) {
+          s.at(2 * p, 2 * p + 2) = ends.v_lo;
+          s.at(2 * p + 1, 2 * p + 2) = ends.v_hi;
+        }
+      }
+      std::vector<int> reduced_piv(reduced.n);
+      if(band_factor(s, reduced, &reduced_piv[0]) >= 0)
+        log_solver.warning("the reduced system of the tridiagonal solve is singular");
+
+      const size_t factor_bytes = reduced_storage.size() * sizeof(double);
+      const size_t piv_bytes = reduced_piv.size() * sizeof(int);
+      reduced_args.resize(factor_bytes + piv_bytes + sizeof(BandShape));
+      memcpy(&reduced_args[0], &reduced_storage[0], factor_bytes);
+      memcpy(&reduced_args[factor_bytes], &reduced_piv[0], piv_bytes);
+      memcpy(&reduced_args[factor_bytes + piv_bytes], &reduced, sizeof(BandShape));
+    }
+    const double factor_ms = (wall_time() - ts_start) * 1e-3;
+    printf("\n Band factorization: %.3f ms\n", factor_ms);
+
+    for(int batch = 0; batch < num_batches; batch++) {
+      double ts_batch = wall_time();
+
+      if(rhs_file == NULL) {
+        RandomArgs rhs_args = { seed, STREAM_RHS + batch };
+        IndexLauncher generate_rhs_launcher(GENERATE_RHS_TASK_ID, block_domain,
+          TaskArgument(&rhs_args, sizeof(rhs_args)), ArgumentMap());
+        generate_rhs_launcher.add_region_requirement(
+          RegionRequirement(rhs_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, rhs_lr));
+        generate_rhs_launcher.add_field(0, FID_RHS);
+        runtime->execute_index_space(ctx, generate_rhs_launcher).wait_all_results();
+      }
+      double ts_solve = wall_time();
+
+      CopyLauncher copy_launcher;
+      copy_launcher.add_copy_requirements(
+        RegionRequirement(rhs_lr, READ_ONLY, EXCLUSIVE, rhs_lr),
+        RegionRequirement(solve_lr, WRITE_DISCARD, EXCLUSIVE, solve_lr));
+      copy_launcher.add_src_field(0, FID_RHS);
+      copy_launcher.add_dst_field(0, FID_SOLVE);
+      runtime->issue_copy_operation(ctx, copy_launcher);
+
+      if(!tridiagonal) {
+        TaskLauncher solve_launcher(BAND_SOLVE_TASK_ID, TaskArgument(&args, sizeof(args)));
+        solve_launcher.add_region_requirement(
+          RegionRequirement(band_lr, READ_ONLY, EXCLUSIVE, band_lr));
+        solve_launcher.add_field(0, FID_BAND);
+        solve_launcher.add_region_requirement(
+          RegionRequirement(perm_lr, READ_ONLY, EXCLUSIVE, perm_lr));
+        solve_launcher.add_field(1, FID_PERM);
+        solve_launcher.add_region_requirement(
+          RegionRequirement(solve_lr, READ_WRITE, EXCLUSIVE, solve_lr));
+        solve_launcher.add_field(2, FID_SOLVE);
+        runtime->execute_task(ctx, solve_launcher).get_void_result();
+      } else {
+        IndexLauncher local_launcher(TRI_LOCAL_TASK_ID, block_domain,
+          TaskArgument(&args, sizeof(args)), ArgumentMap());
+        local_launcher.add_region_requirement(
+          RegionRequirement(band_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, band_lr));
+        local_launcher.add_field(0, FID_BAND);
+        local_launcher.add_region_requirement(
+          RegionRequirement(solve_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, solve_lr));
+        local_launcher.add_field(1, FID_SOLVE);
+        local_launcher.add_region_requirement(
+          RegionRequirement(boundary_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, boundary_lr));
+        local_launcher.add_field(2, FID_BOUNDARY);
+        runtime->execute_index_space(ctx, local_launcher);
+
+        TaskLauncher reduced_launcher(TRI_REDUCED_TASK_ID,
+          TaskArgument(&reduced_args[0], reduced_args.size()));
+        reduced_launcher.add_region_requirement(
+          RegionRequirement(boundary_lr, READ_WRITE, EXCLUSIVE, boundary_lr));
+        reduced_launcher.add_field(0, FID_BOUNDARY);
+        runtime->execute_task(ctx, reduced_launcher);
+
+        IndexLauncher correct_launcher(TRI_CORRECT_TASK_ID, block_domain,
+          TaskArgument(&args, sizeof(args)), ArgumentMap());
+        correct_launcher.add_region_requirement(
+          RegionRequirement(spike_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, spike_lr));
+        correct_launcher.add_field(0, FID_SPIKE_V);
+        correct_launcher.add_field(0, FID_SPIKE_W);
+        correct_launcher.add_region_requirement(
+          RegionRequirement(boundary_lr, READ_ONLY, EXCLUSIVE, boundary_lr));
+        correct_launcher.add_field(1, FID_BOUNDARY);
+        correct_launcher.add_region_requirement(
+          RegionRequirement(solve_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, solve_lr));
+        correct_launcher.add_field(2, FID_SOLVE);
+        runtime->execute_index_space(ctx, correct_launcher).wait_all_results();
+      }
+
+      double ts_end = wall_time();
+      printf("\n Batch %d: %d RHS generated in %.3f ms, solved in %.3f ms\n",
+             batch, nrhs, (ts_solve - ts_batch) * 1e-3, (ts_end - ts_solve) * 1e-3);
+    }
+
+    if(verify) {
+      double ts_verify = wall_time();
+      IndexLauncher residual_launcher(BAND_RESIDUAL_TASK_ID, block_domain,
+        TaskArgument(&args, sizeof(args)), ArgumentMap());
+      residual_launcher.add_region_requirement(
+        RegionRequirement(band_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, band_lr));
+      residual_launcher.add_field(0, FID_ORIGINAL);
+      residual_launcher.add_region_requirement(
+        RegionRequirement(solve_lr, READ_ONLY, EXCLUSIVE, solve_lr));
+      residual_launcher.add_field(1, FID_SOLVE);
+      residual_launcher.add_region_requirement(
+        RegionRequirement(rhs_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, rhs_lr));
+      residual_launcher.add_field(2, FID_RHS);
+      ResidualNorms norms = runtime->execute_index_space(ctx, residual_launcher,
+          RESIDUAL_REDOP_ID).get_result<ResidualNorms>();
+      report_verification(norms, n, (wall_time() - ts_verify) * 1e-3);
+    }
+
+    if(out_path != NULL)
+      write_solution_file(ctx, runtime, out_path, solve_lr, solve_lp, FID_SOLVE, num_blocks);
+
+    if(tridiagonal) {
+      runtime->destroy_logical_region(ctx, spike_lr);
+      runtime->destroy_logical_region(ctx, boundary_lr);
+      runtime->destroy_index_space(ctx, spike_is);
+      runtime->destroy_index_space(ctx, boundary_is);
+    } else {
+      runtime->destroy_logical_region(ctx, perm_lr);
+      runtime->destroy_index_space(ctx, perm_is);
+    }
+  }
+  runtime->destroy_logical_region(ctx, rhs_lr);
+  runtime->destroy_logical_region(ctx, solve_lr);
+  runtime->destroy_logical_region(ctx, band_lr);
+  runtime->destroy_field_space(ctx, rhs_fs);
+  runtime->destroy_field_space(ctx, solve_fs);
+  runtime->destroy_field_space(ctx, aux_fs);
+  runtime->destroy_field_space(ctx, boundary_fs);
+  runtime->destroy_field_space(ctx, band_fs);
+  runtime->destroy_index_space(ctx, rhs_is);
+  runtime->destroy_index_space(ctx, band_is);
+}
+
+void register_band_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<band_init_task>
+            (BAND_INIT_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<band_getrf_task>
+            (BAND_GETRF_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<band_solve_task>
+            (BAND_SOLVE_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<ResidualNorms, band_residual_task>
+            (BAND_RESIDUAL_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<SpikeEnds, tri_factor_task>
+            (TRI_FACTOR_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<tri_local_task>
+            (TRI_LOCAL_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<tri_reduced_task>
+            (TRI_REDUCED_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<tri_correct_task>
+            (TRI_CORRECT_TASK_ID, Processor::LOC_PROC, false, true);
+}
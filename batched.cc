@@ -0,0 +1,324 @@
+#include "array_populate.h"
+
+/*
+ * Many small independent systems (-small N -systems M): one task solves a
+ * whole range of systems, and the ranges are index launched over the row
+ * blocks, one per CPU by default. The systems are interleaved: entry e of
+ * system s is point (s, e) of a (system, entry) region, so entry e of
+ * consecutive systems is contiguous, and the kernel eliminates
+ * BATCH_LANES systems at once with one vector operation per entry.
+ *
+ * The kernel is a template on N, so the loops of the common sizes have
+ * constant trip counts that the compiler unrolls, and it is instantiated
+ * once more for every vector ISA of kernels.cc. The elimination does not
+ * pivot: the generated systems are diagonally dominant.
+ */
+
+#define BATCH_LANES 8
+
+/* BATCH_LANES doubles, loaded and stored at any double boundary */
+typedef double Lanes __attribute__((vector_size(BATCH_LANES * sizeof(double))));
+typedef Lanes UnalignedLanes __attribute__((aligned(sizeof(double)), may_alias));
+#define LANES(p) (*(UnalignedLanes *) (p))
+
+struct BatchArgs {
+  int n, num_systems, batch;
+  unsigned long long seed;
+};
+
+/* Entry e = i * n + j of system s of a batch, and entry i of its RHS */
+static inline double batch_matrix_entry(const BatchArgs &args, int s, int e)
+{
+  RandomArgs random = { args.seed, STREAM_MATRIX };
+  const int i = e / args.n, j = e % args.n;
+  return random_entry(random, args.batch * args.num_systems + s, e, 1000) * 1e-3 +
+         ((i == j) ? args.n : 0);
+}
+
+static inline double batch_rhs_entry(const BatchArgs &args, int s, int i)
+{
+  RandomArgs random = { args.seed, STREAM_RHS + args.batch };
+  return 2 + random_entry(random, s, i, 10);
+}
+
+/*
+ * Solves BATCH_LANES systems in place: entry (i, j) of the matrices at
+ * a[(i * n + j) * a_stride], entry i of the RHS at b[i * b_stride]. N = 0
+ * takes the size from n at run time.
+ */
+template<int N>
+static inline __attribute__((always_inline))
+void batch_lu_solve(double *a, long a_stride, double *b, long b_stride, int n_dyn)
+{
+  const int n = (N > 0) ? N : n_dyn;
+  Lanes one;
+  for(int l = 0; l < BATCH_LANES; l++)
+    one[l] = 1.0;
+
+  // Forward elimination of A and b together
+  for(int k = 0; k < n; k++) {
+    const Lanes inv = one / LANES(&a[(k * n + k) * a_stride]);
+    const Lanes bk = LANES(&b[k * b_stride]);
+    for(int i = k + 1; i < n; i++) {
+      const Lanes m = LANES(&a[(i * n + k) * a_stride]) * inv;
+      for(int j = k + 1; j < n; j++)
+        LANES(&a[(i * n + j) * a_stride]) -= m * LANES(&a[(k * n + j) * a_stride]);
+      LANES(&b[i * b_stride]) -= m * bk;
+    }
+  }
+
+  for(int i = n - 1; i >= 0; i--) {
+    Lanes s = LANES(&b[i * b_stride]);
+    for(int j = i + 1; j < n; j++)
+      s -= LANES(&a[(i * n + j) * a_stride]) * LANES(&b[j * b_stride]);
+    LANES(&b[i * b_stride]) = s / LANES(&a[(i * n + i) * a_stride]);
+  }
+}
+
+template<int N>
+static void batch_kernel_generic(double *a, long a_stride, double *b, long b_stride, int n)
+{
+  batch_lu_solve<N>(a, a_stride, b, b_stride, n);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template<int N>
+__attribute__((target("avx2,fma")))
+static void batch_kernel_avx2(double *a, long a_stride, double *b, long b_stride, int n)
+{
+  batch_lu_solve<N>(a, a_stride, b, b_stride, n);
+}
+
+template<int N>
+__attribute__((target("avx512f")))
+static void batch_kernel_avx512(double *a, long a_stride, double *b, long b_stride, int n)
+{
+  batch_lu_solve<N>(a, a_stride, b, b_stride, n);
+}
+#endif
+
+typedef void (*BatchKernel)(double *, long, double *, long, int);
+
+template<int N>
+static BatchKernel batch_kernel_isa(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(!strcmp(kernel_isa_name(), "avx512"))
+    return batch_kernel_avx512<N>;
+  if(!strcmp(kernel_isa_name(), "avx2"))
+    return batch_kernel_avx2<N>;
+#endif
+  return batch_kernel_generic<N>;
+}
+
+/* The kernel of size n for the ISA that init_kernels picked */
+static BatchKernel batch_kernel(int n)
+{
+  switch(n) {
+    case 4:
+      return batch_kernel_isa<4>();
+    case 8:
+      return batch_kernel_isa<8>();
+    case 16:
+      return batch_kernel_isa<16>();
+    case 32:
+      return batch_kernel_isa<32>();
+    case 64:
+      return batch_kernel_isa<64>();
+    default:
+      return batch_kernel_isa<0>();
+  }
+}
+
+/* Generates the systems of a block into regions 0 (matrices) and 1 (RHS) */
+void batch_init_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BatchArgs args = *((const BatchArgs *) task->args);
+
+  FieldID fid_a = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[1].privilege_fields.begin());
+  Rect<2> a_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  Rect<2> b_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  DenseBlock a = get_dense_block(regions[0], fid_a, a_rect);
+  DenseBlock b = get_dense_block(regions[1], fid_b, b_rect);
+
+  // Along the systems, which are contiguous
+  for(int e = a_rect.lo[1]; e <= a_rect.hi[1]; e++)
+    for(int s = a_rect.lo[0]; s <= a_rect.hi[0]; s++)
+      a.at(s, e) = batch_matrix_entry(args, s, e);
+  for(int i = b_rect.lo[1]; i <= b_rect.hi[1]; i++)
+    for(int s = b_rect.lo[0]; s <= b_rect.hi[0]; s++)
+      b.at(s, i) = batch_rhs_entry(args, s, i);
+}
+
+/* Solves the systems of a block; the RHS are overwritten with x */
+void batch_solve_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BatchArgs args = *((const BatchArgs *) task->args);
+
+  FieldID fid_a = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[1].privilege_fields.begin());
+  Rect<2> a_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  Rect<2> b_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  DenseBlock a = get_dense_block(regions[0], fid_a, a_rect);
+  DenseBlock b = get_dense_block(regions[1], fid_b, b_rect);
+  assert((a.row_stride == 1) && (b.row_stride == 1));
+  assert(a_rect.dim_size(0) % BATCH_LANES == 0);
+
+  const BatchKernel kernel = batch_kernel(args.n);
+  for(int s = a_rect.lo[0]; s <= a_rect.hi[0]; s += BATCH_LANES)
+    kernel(&a.at(s, 0), a.col_stride, &b.at(s, 0), b.col_stride, args.n);
+}
+
+/* r = b - A x of every system of a block, A and b from the generator again */
+ResidualNorms batch_residual_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const BatchArgs args = *((const BatchArgs *) task->args);
+  const int n = args.n;
+
+  FieldID fid_x = *(task->regions[0].privilege_fields.begin());
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock x = get_dense_block(regions[0], fid_x, x_rect);
+
+  ResidualNorms norms = ResidualReduction::identity;
+  const int last = std::min((int) x_rect.hi[0], args.num_systems - 1);
+  for(int s = x_rect.lo[0]; s <= last; s++) {
+    for(int i = 0; i < n; i++) {
+      const double bi = batch_rhs_entry(args, s, i);
+      double r = bi;
+      for(int j = 0; j < n; j++) {
+        const double aij = batch_matrix_entry(args, s, i * n + j);
+        r -= aij * x.at(s, j);
+        norms.a_sq += aij * aij;
+      }
+      norms.r_sq += r * r;
+      norms.b_sq += bi * bi;
+      norms.x_sq += x.at(s, i) * x.at(s, i);
+      norms.r_max = std::max(norms.r_max, fabs(r));
+    }
+  }
+  return norms;
+}
+
+void batched_solve(Context ctx, HighLevelRuntime *runtime, int n, int num_systems,
+                   int num_batches, int num_blocks, unsigned long long seed, bool verify)
+{
+  // Whole groups of BATCH_LANES systems; the padding is solved and ignored
+  const int num_groups = (num_systems + BATCH_LANES - 1) / BATCH_LANES;
+  const int padded = num_groups * BATCH_LANES;
+  num_blocks = std::max(1, std::min(num_blocks, num_groups));
+  std::vector<int> system_lo(num_blocks + 1);
+  for(int b = 0; b <= num_blocks; b++)
+    system_lo[b] = (int) (((long long) num_groups * b) / num_blocks) * BATCH_LANES;
+
+  printf("\n Solving %d batch(es) of %d independent %d x %d systems over %d blocks"
+         " (%s kernels, %d systems per vector, %s mapper)",
+         num_batches, num_systems, n, n, num_blocks, kernel_isa_name(), BATCH_LANES,
+         solver_mapper_name());
+
+  Rect<2> a_rect(make_point(0, 0), make_point(padded - 1, n * n - 1));
+  Rect<2> b_rect(make_point(0, 0), make_point(padded - 1, n - 1));
+  IndexSpace a_is = runtime->create_index_space(ctx, Domain::from_rect<2>(a_rect));
+  IndexSpace b_is = runtime->create_index_space(ctx, Domain::from_rect<2>(b_rect));
+  FieldSpace a_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, a_fs);
+    allocator.allocate_field(sizeof(double), FID_INPUT);
+  }
+  FieldSpace b_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, b_fs);
+    allocator.allocate_field(sizeof(double), FID_SOLVE);
+  }
+  LogicalRegion a_lr = runtime->create_logical_region(ctx, a_is, a_fs);
+  LogicalRegion b_lr = runtime->create_logical_region(ctx, b_is, b_fs);
+  IndexPartition a_ip = create_row_blocks(ctx, runtime, a_is, system_lo, false);
+  IndexPartition b_ip = create_row_blocks(ctx, runtime, b_is, system_lo, false);
+  LogicalPartition a_lp = runtime->get_logical_partition(ctx, a_lr, a_ip);
+  LogicalPartition b_lp = runtime->get_logical_partition(ctx, b_lr, b_ip);
+
+  Rect<1> block_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain block_domain = Domain::from_rect<1>(block_bounds);
+
+  BatchArgs args;
+  args.n = n;
+  args.num_systems = num_systems;
+  args.seed = seed;
+
+  // 2 n^3 / 3 for the elimination, 2 n^2 for the substitutions
+  const double flops = (double) num_systems * (2.0 * n * n * n / 3.0 + 2.0 * n * n);
+  for(int batch = 0; batch < num_batches; batch++) {
+    args.batch = batch;
+    double ts_batch = wall_time();
+
+    IndexLauncher init_launcher(BATCH_INIT_TASK_ID, block_domain,
+      TaskArgument(&args, sizeof(args)), ArgumentMap());
+    init_launcher.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, a_lr));
+    init_launcher.add_field(0, FID_INPUT);
+    init_launcher.add_region_requirement(
+      RegionRequirement(b_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, b_lr));
+    init_launcher.add_field(1, FID_SOLVE);
+    runtime->execute_index_space(ctx, init_launcher).wait_all_results();
+    double ts_solve = wall_time();
+
+    IndexLauncher solve_launcher(BATCH_SOLVE_TASK_ID, block_domain,
+      TaskArgument(&args, sizeof(args)), ArgumentMap());
+    solve_launcher.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, a_lr));
+    solve_launcher.add_field(0, FID_INPUT);
+    solve_launcher.add_region_requirement(
+      RegionRequirement(b_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, b_lr));
+    solve_launcher.add_field(1, FID_SOLVE);
+    runtime->execute_index_space(ctx, solve_launcher).wait_all_results();
+
+    double ts_end = wall_time();
+    const double solve_ms = (ts_end - ts_solve) * 1e-3;
+    printf("\n Batch %d: generated in %.3f ms, solved in %.3f ms, %.2f M systems/s, %.2f GFLOP/s\n",
+           batch, (ts_solve - ts_batch) * 1e-3, solve_ms,
+           (solve_ms > 0) ? num_systems / (solve_ms * 1e3) : 0.0,
+           (solve_ms > 0) ? flops / (solve_ms * 1e6) : 0.0);
+  }
+
+  if(verify) {
+    double ts_verify = wall_time();
+    IndexLauncher residual_launcher(BATCH_RESIDUAL_TASK_ID, block_domain,
+      TaskArgument(&args, sizeof(args)), ArgumentMap());
+    residual_launcher.add_region_requirement(
+      RegionRequirement(b_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, b_lr));
+    residual_launcher.add_field(0, FID_SOLVE);
+    ResidualNorms norms = runtime->execute_index_space(ctx, residual_launcher,
+        RESIDUAL_REDOP_ID).get_result<ResidualNorms>();
+    report_verification(norms, n, (wall_time() - ts_verify) * 1e-3);
+  }
+
+  runtime->destroy_logical_region(ctx, a_lr);
+  runtime->destroy_logical_region(ctx, b_lr);
+  runtime->destroy_field_space(ctx, a_fs);
+  runtime->destroy_field_space(ctx, b_fs);
+  runtime->destroy_index_space(ctx, a_is);
+  runtime->destroy_index_space(ctx, b_is);
+}
+
+void register_batched_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<batch_init_task>
+            (BATCH_INIT_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<batch_solve_task>
+            (BATCH_SOLVE_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<ResidualNorms, batch_residual_task>
+            (BATCH_RESIDUAL_TASK_ID, Processor::LOC_PROC, false, true);
+}
@@ -0,0 +1,232 @@
+#include "array_populate.h"
+
+/*
+ * Blocked triangular solves with the LU factors that the elimination leaves
+ * in the matrix: L (unit diagonal) below the diagonal, U on and above it.
+ * The solution c starts as a copy of the RHS in solve_lr, with the row
+ * swaps of the factorization applied, and is overwritten block by block.
+ * The forward sweep with L goes down the row blocks, the back sweep with U
+ * goes up, and for every row block b:
+ *
+ *   SOLVE   c(b) = T(b,b)^-1 c(b)
+ *   UPDATE  c(i) = c(i) - T(i,b) c(b)          i after b, one index launch
+ *
+ * The updates of the other blocks run in parallel, and the next block is
+ * solved as soon as its own update has finished. Every RHS column of
+ * solve_lr is swept at once, so a batch of right hand sides costs the same
+ * number of launches as a single one. The factors are double, or float for
+ * the correction solves of the mixed precision refinement.
+ */
+
+/* Copies column r of a (row, rhs) block to a dense vector and back */
+static void get_column(const DenseBlock &block, const Rect<2> &rect, int r,
+                       std::vector<double> &x)
+{
+  x.resize(rect.dim_size(0));
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    x[i - rect.lo[0]] = block.at(i, r);
+}
+
+static void put_column(const DenseBlock &block, const Rect<2> &rect, int r,
+                       const std::vector<double> &x)
+{
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    block.at(i, r) = x[i - rect.lo[0]];
+}
+
+template<typename T>
+void solve_block_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const bool lower = *((const bool *) task->args);
+
+  FieldID fid_inp = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_solve = *(task->regions[1].privilege_fields.begin());
+
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  const int row = solve_rect.lo[0];
+  const int m = solve_rect.dim_size(0);
+
+  DenseBlockOf<T> inp = get_typed_matrix_block<T>(regions[0], fid_inp, rect);
+  DenseBlock solve = get_dense_block(regions[1], fid_solve, solve_rect);
+
+  std::vector<double> x;
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    get_column(solve, solve_rect, r, x);
+    if(lower)
+      kernel_unit_lower_solve(inp, row, m, &x[0]);
+    else
+      kernel_upper_solve(inp, row, m, &x[0]);
+    put_column(solve, solve_rect, r, x);
+  }
+}
+
+/*
+ * c = P b for the rows of one block. The swaps are sequential, so every
+ * block replays them on row indices, O(n), to find the row of b that ends
+ * up in each of its rows, and then copies just those rows.
+ */
+void permute_rhs_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_perm = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_rhs = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_solve = *(task->regions[2].privilege_fields.begin());
+
+  Rect<1> perm_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  const int *perm = get_dense_index_vector(regions[0], fid_perm, perm_rect);
+  Rect<2> rhs_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  DenseBlock rhs = get_dense_block(regions[1], fid_rhs, rhs_rect);
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[2], fid_solve, solve_rect);
+
+  // source[k] is the row of b that the swaps move to row k
+  const int n = perm_rect.dim_size(0);
+  std::vector<int> source(n);
+  for(int k = 0; k < n; k++)
+    source[k] = k;
+  for(int k = 0; k < n - 1; k++)
+    std::swap(source[k], source[perm[k]]);
+
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++)
+    for(int k = solve_rect.lo[0]; k <= solve_rect.hi[0]; k++)
+      solve.at(k, r) = rhs.at(source[k], r);
+}
+
+template<typename T>
+void update_block_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_inp = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_solve = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_x = *(task->regions[2].privilege_fields.begin());
+
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+
+  DenseBlockOf<T> inp = get_typed_matrix_block<T>(regions[0], fid_inp, rect);
+  DenseBlock solve = get_dense_block(regions[1], fid_solve, solve_rect);
+  DenseBlock xb = get_dense_block(regions[2], fid_x, x_rect);
+
+  std::vector<double> c, x;
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    get_column(solve, solve_rect, r, c);
+    get_column(xb, x_rect, r, x);
+    kernel_gemv(inp, solve_rect.lo[0], x_rect.lo[0],
+                solve_rect.dim_size(0), x_rect.dim_size(0), -1.0, &x[0], &c[0]);
+    put_column(solve, solve_rect, r, c);
+  }
+}
+
+/* Returns the future of the last diagonal solve, which ends the sweep */
+static Future triangular_sweep(Context ctx, HighLevelRuntime *runtime,
+                             LogicalRegion input_lr, LogicalPartition input_lp,
+                             FieldID factor_fid,
+                             LogicalRegion solve_lr, LogicalPartition solve_lp,
+                             int num_blocks, bool lower)
+{
+  const bool single = (factor_fid == FID_FACTOR);
+  Future last_f;
+
+  for(int step = 0; step < num_blocks; step++) {
+    const int b = lower ? step : (num_blocks - 1 - step);
+    LogicalRegion solve_block = runtime->get_logical_subregion_by_color(ctx, solve_lp, b);
+
+    TaskLauncher solve_launcher(single ? SOLVE_BLOCK_SP_TASK_ID : SOLVE_BLOCK_TASK_ID,
+                                TaskArgument(&lower, sizeof(lower)));
+    solve_launcher.tag = owner_tag(b);
+    solve_launcher.add_region_requirement(
+      RegionRequirement(runtime->get_logical_subregion_by_color(ctx, input_lp, b),
+                        READ_ONLY, EXCLUSIVE, input_lr));
+    solve_launcher.add_field(0, factor_fid);
+    solve_launcher.add_region_requirement(
+      RegionRequirement(solve_block, READ_WRITE, EXCLUSIVE, solve_lr));
+    solve_launcher.add_field(1, FID_SOLVE);
+    last_f = runtime->execute_task(ctx, solve_launcher);
+
+    if(step == num_blocks - 1)
+      break;
+
+    // The blocks that still depend on block b
+    Rect<1> launch_bounds = lower ? Rect<1>(Point<1>(b + 1), Point<1>(num_blocks - 1))
+                                  : Rect<1>(Point<1>(0), Point<1>(b - 1));
+    IndexLauncher update_launcher(single ? UPDATE_BLOCK_SP_TASK_ID : UPDATE_BLOCK_TASK_ID,
+      Domain::from_rect<1>(launch_bounds), TaskArgument(NULL, 0), ArgumentMap());
+    update_launcher.add_region_requirement(
+      RegionRequirement(input_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, input_lr));
+    update_launcher.add_field(0, factor_fid);
+    update_launcher.add_region_requirement(
+      RegionRequirement(solve_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, solve_lr));
+    update_launcher.add_field(1, FID_SOLVE);
+    update_launcher.add_region_requirement(
+      RegionRequirement(solve_block, READ_ONLY, EXCLUSIVE, solve_lr));
+    update_launcher.add_field(2, FID_SOLVE);
+    runtime->execute_index_space(ctx, update_launcher);
+  }
+  return last_f;
+}
+
+Future lu_solve(Context ctx, HighLevelRuntime *runtime,
+              LogicalRegion input_lr, LogicalPartition input_lp, FieldID factor_fid,
+              LogicalRegion perm_lr, LogicalRegion rhs_lr,
+              LogicalRegion solve_lr, LogicalPartition solve_lp, int num_blocks)
+{
+  if(perm_lr.exists()) {
+    // P b, every block gathering its own rows from b in parallel
+    Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+    IndexLauncher permute_launcher(PERMUTE_RHS_TASK_ID, Domain::from_rect<1>(launch_bounds),
+      TaskArgument(NULL, 0), ArgumentMap());
+    permute_launcher.add_region_requirement(
+      RegionRequirement(perm_lr, READ_ONLY, EXCLUSIVE, perm_lr));
+    permute_launcher.add_field(0, FID_PERM);
+    permute_launcher.add_region_requirement(
+      RegionRequirement(rhs_lr, READ_ONLY, EXCLUSIVE, rhs_lr));
+    permute_launcher.add_field(1, FID_RHS);
+    permute_launcher.add_region_requirement(
+      RegionRequirement(solve_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, solve_lr));
+    permute_launcher.add_field(2, FID_SOLVE);
+    runtime->execute_index_space(ctx, permute_launcher);
+  } else {
+    CopyLauncher copy_launcher;
+    copy_launcher.add_copy_requirements(
+      RegionRequirement(rhs_lr, READ_ONLY, EXCLUSIVE, rhs_lr),
+      RegionRequirement(solve_lr, WRITE_DISCARD, EXCLUSIVE, solve_lr));
+    copy_launcher.add_src_field(0, FID_RHS);
+    copy_launcher.add_dst_field(0, FID_SOLVE);
+    runtime->issue_copy_operation(ctx, copy_launcher);
+  }
+
+  triangular_sweep(ctx, runtime, input_lr, input_lp, factor_fid, solve_lr, solve_lp,
+                   num_blocks, true /* lower */);
+  return triangular_sweep(ctx, runtime, input_lr, input_lp, factor_fid, solve_lr, solve_lp,
+                          num_blocks, false /* upper */);
+}
+
+void register_block_solve_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<solve_block_task<double> >
+            (SOLVE_BLOCK_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<solve_block_task<float> >
+            (SOLVE_BLOCK_SP_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<permute_rhs_task>
+            (PERMUTE_RHS_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<update_block_task<double> >
+            (UPDATE_BLOCK_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<update_block_task<float> >
+            (UPDATE_BLOCK_SP_TASK_ID, Processor::LOC_PROC, true, true);
+}
@@ -0,0 +1,687 @@
+#include "array_populate.h"
+
+/*
+ * Tiled Cholesky factorization of a symmetric positive definite matrix,
+ * A = L L^T, right-looking over the tiles of the lower triangle:
+ *
+ *   POTRF  A(k,k) = L(k,k) L(k,k)^T
+ *   TRSM   A(i,k) = A(i,k) L(k,k)^-T               i > k
+ *   SYRK   A(i,i) = A(i,i) - A(i,k) A(i,k)^T        i > k, lower half
+ *   GEMM   A(i,j) = A(i,j) - A(i,k) A(j,k)^T        k < j < i
+ *
+ * Only the tiles (i, j) with i >= j are stored, packed one after the other
+ * in a (element, tile) region: tile (i, j) is row-major in column
+ * i (i + 1) / 2 + j, and the tiles of tile row i are contiguous. The
+ * factorization touches no tile above the diagonal, so it streams half the
+ * matrix and does n^3 / 3 flops instead of the 2 n^3 / 3 of LU.
+ *
+ * x comes from the same blocked sweeps as the LU solve, over tile rows:
+ * forward with L, then backward with L^T, every diagonal solve followed by
+ * the updates of the blocks that depend on it. The tile tasks run on the
+ * owners of the grid of the tiled LU engine.
+ */
+
+struct PackedTiles {
+  int n, tile_size, num_tiles;
+};
+
+/* Arguments of every task below; each reads the fields it needs */
+struct CholArgs {
+  PackedTiles tiles;
+  int ti, tj, tk;     // the tile written, (ti, tj), and the step k
+  bool transpose;     // solve or update with L^T
+  RandomArgs random;  // CHOL_INIT only
+};
+
+static inline long packed_tile(int ti, int tj)
+{
+  return (long) ti * (ti + 1) / 2 + tj;
+}
+
+/* Rows (or columns) of tile row t, the last one being short */
+static inline int tile_dim(const PackedTiles &tiles, int t)
+{
+  return std::min(tiles.tile_size, tiles.n - t * tiles.tile_size);
+}
+
+/* The packed tiles mapped by requirement idx */
+static DenseBlock map_packed(Context ctx, HighLevelRuntime *runtime, const Task *task,
+                             const std::vector<PhysicalRegion> &regions, int idx)
+{
+  FieldID fid = *(task->regions[idx].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[idx].region.get_index_space()).get_rect<2>();
+  DenseBlock packed = get_dense_block(regions[idx], fid, rect);
+  assert(packed.row_stride == 1);
+  return packed;
+}
+
+/* Element (0, 0) of tile t, element (r, c) being at [r * tile_size + c] */
+static inline double *tile_ptr(const DenseBlock &packed, long t)
+{
+  return &packed.at(0, (int) t);
+}
+
+/* A(i, j) of the symmetric matrix, from the tile that stores it */
+static inline double packed_at(const DenseBlock &packed, int tile_size, int i, int j)
+{
+  if(j > i)
+    std::swap(i, j);
+  const int ti = i / tile_size, tj = j / tile_size;
+  return tile_ptr(packed, packed_tile(ti, tj))[(i - ti * tile_size) * tile_size +
+                                              (j - tj * tile_size)];
+}
+
+/* Generates tile row i: symmetric, with n added to the diagonal */
+void chol_init_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int ti = task->index_point.point_data[0];
+  const int b = args.tiles.tile_size;
+  DenseBlock packed = map_packed(ctx, runtime, task, regions, 0);
+
+  // Entries in [0, 1), so every row is diagonally dominant
+  for(int tj = 0; tj <= ti; tj++) {
+    double *a = tile_ptr(packed, packed_tile(ti, tj));
+    std::fill(a, a + b * b, 0.0);
+    for(int r = 0; r < tile_dim(args.tiles, ti); r++) {
+      const int i = ti * b + r;
+      for(int c = 0; c < tile_dim(args.tiles, tj); c++) {
+        const int j = tj * b + c;
+        if(j > i)
+          break;
+        a[r * b + c] = random_entry(args.random, i, j, 1000) * 1e-3 +
+                       ((i == j) ? args.tiles.n : 0);
+      }
+    }
+  }
+}
+
+/* Packs the lower triangle of tile row i of a loaded square matrix */
+void chol_pack_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int ti = task->index_point.point_data[0];
+  const int b = args.tiles.tile_size;
+
+  FieldID fid_inp = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  DenseBlock inp = get_matrix_block(regions[0], fid_inp, rect);
+  DenseBlock packed = map_packed(ctx, runtime, task, regions, 1);
+
+  for(int tj = 0; tj <= ti; tj++) {
+    double *a = tile_ptr(packed, packed_tile(ti, tj));
+    std::fill(a, a + b * b, 0.0);
+    for(int r = 0; r < tile_dim(args.tiles, ti); r++) {
+      const int i = ti * b + r;
+      for(int c = 0; c < tile_dim(args.tiles, tj); c++) {
+        const int j = tj * b + c;
+        if(j > i)
+          break;
+        a[r * b + c] = inp.at(i, j);
+      }
+    }
+  }
+}
+
+/* The tile of requirement idx, which holds a single tile */
+static double *map_single_tile(Context ctx, HighLevelRuntime *runtime, const Task *task,
+                               const std::vector<PhysicalRegion> &regions, int idx)
+{
+  FieldID fid = *(task->regions[idx].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[idx].region.get_index_space()).get_rect<2>();
+  DenseBlock packed = get_dense_block(regions[idx], fid, rect);
+  assert(packed.row_stride == 1);
+  return tile_ptr(packed, rect.lo[1]);
+}
+
+void chol_potrf_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int m = tile_dim(args.tiles, args.tk);
+  double *a = map_single_tile(ctx, runtime, task, regions, 0);
+
+  for(int j = 0; j < m; j++) {
+    const double d = a[j * b + j] - kernel_dot(&a[j * b], 1, &a[j * b], 1, j);
+    if(d <= 0) {
+      log_solver.warning("matrix is not positive definite: pivot %d is %e",
+                         args.tk * b + j, d);
+      return;
+    }
+    const double ljj = sqrt(d);
+    a[j * b + j] = ljj;
+    for(int i = j + 1; i < m; i++)
+      a[i * b + j] = (a[i * b + j] - kernel_dot(&a[i * b], 1, &a[j * b], 1, j)) / ljj;
+  }
+}
+
+/* A(i,k) = A(i,k) L(k,k)^-T, one row of A(i,k) at a time */
+void chol_trsm_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int m = tile_dim(args.tiles, args.tk);
+  const int h = tile_dim(args.tiles, args.ti);
+  const double *l = map_single_tile(ctx, runtime, task, regions, 0);
+  double *x = map_single_tile(ctx, runtime, task, regions, 1);
+
+  for(int r = 0; r < h; r++)
+    for(int j = 0; j < m; j++)
+      x[r * b + j] = (x[r * b + j] - kernel_dot(&x[r * b], 1, &l[j * b], 1, j)) / l[j * b + j];
+}
+
+/* A(i,i) -= A(i,k) A(i,k)^T, on and below the diagonal */
+void chol_syrk_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int m = tile_dim(args.tiles, args.tk);
+  const int h = tile_dim(args.tiles, args.ti);
+  const double *a = map_single_tile(ctx, runtime, task, regions, 0);
+  double *c = map_single_tile(ctx, runtime, task, regions, 1);
+
+  for(int i = 0; i < h; i++)
+    for(int j = 0; j <= i; j++)
+      c[i * b + j] -= kernel_dot(&a[i * b], 1, &a[j * b], 1, m);
+}
+
+/* A(i,j) -= A(i,k) A(j,k)^T: every entry is a dot product of two rows */
+void chol_gemm_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int m = tile_dim(args.tiles, args.tk);
+  const int h = tile_dim(args.tiles, args.ti);
+  const int w = tile_dim(args.tiles, args.tj);
+  const double *a = map_single_tile(ctx, runtime, task, regions, 0);
+  const double *bt = map_single_tile(ctx, runtime, task, regions, 1);
+  double *c = map_single_tile(ctx, runtime, task, regions, 2);
+
+  for(int i = 0; i < h; i++)
+    for(int j = 0; j < w; j++)
+      c[i * b + j] -= kernel_dot(&a[i * b], 1, &bt[j * b], 1, m);
+}
+
+/* c(i) = L(i,i)^-1 c(i), or L(i,i)^-T c(i) in the backward sweep */
+void chol_solve_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int m = tile_dim(args.tiles, args.ti);
+  const double *l = map_single_tile(ctx, runtime, task, regions, 0);
+
+  FieldID fid_solve = *(task->regions[1].privilege_fields.begin());
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[1], fid_solve, solve_rect);
+  const int row = solve_rect.lo[0];
+
+  std::vector<double> x(m);
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    for(int i = 0; i < m; i++)
+      x[i] = solve.at(row + i, r);
+    if(!args.transpose) {
+      for(int i = 0; i < m; i++)
+        x[i] = (x[i] - kernel_dot(&l[i * b], 1, &x[0], 1, i)) / l[i * b + i];
+    } else {
+      // Column i of L is row i of L^T
+      for(int i = m - 1; i >= 0; i--) {
+        x[i] /= l[i * b + i];
+        kernel_axpy(&x[0], 1, &l[i * b], 1, -x[i], i);
+      }
+    }
+    for(int i = 0; i < m; i++)
+      solve.at(row + i, r) = x[i];
+  }
+}
+
+/*
+ * c(i) -= L(i,j) x(j) in the forward sweep, c(j) -= L(i,j)^T x(i) in the
+ * backward one, with L(i,j) the tile (ti, tj) of the arguments
+ */
+void chol_update_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int h = tile_dim(args.tiles, args.ti);
+  const int w = tile_dim(args.tiles, args.tj);
+  const double *l = map_single_tile(ctx, runtime, task, regions, 0);
+
+  FieldID fid_solve = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_x = *(task->regions[2].privilege_fields.begin());
+  Rect<2> solve_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock solve = get_dense_block(regions[1], fid_solve, solve_rect);
+  DenseBlock xb = get_dense_block(regions[2], fid_x, x_rect);
+
+  std::vector<double> c(solve_rect.dim_size(0)), x(x_rect.dim_size(0));
+  for(int r = solve_rect.lo[1]; r <= solve_rect.hi[1]; r++) {
+    for(unsigned i = 0; i < c.size(); i++)
+      c[i] = solve.at(solve_rect.lo[0] + i, r);
+    for(unsigned i = 0; i < x.size(); i++)
+      x[i] = xb.at(x_rect.lo[0] + i, r);
+
+    if(!args.transpose) {
+      for(int i = 0; i < h; i++)
+        c[i] -= kernel_dot(&l[i * b], 1, &x[0], 1, w);
+    } else {
+      for(int i = 0; i < h; i++)
+        kernel_axpy(&c[0], 1, &l[i * b], 1, -x[i], w);
+    }
+
+    for(unsigned i = 0; i < c.size(); i++)
+      solve.at(solve_rect.lo[0] + i, r) = c[i];
+  }
+}
+
+/* r = b - A x over tile row i, with the norms of -verify */
+ResidualNorms chol_residual_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const CholArgs args = *((const CholArgs *) task->args);
+  const int b = args.tiles.tile_size;
+  const int n = args.tiles.n;
+  DenseBlock packed = map_packed(ctx, runtime, task, regions, 0);
+
+  FieldID fid_x = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[2].privilege_fields.begin());
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> b_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+  DenseBlock xb = get_dense_block(regions[1], fid_x, x_rect);
+  DenseBlock bb = get_dense_block(regions[2], fid_b, b_rect);
+
+  ResidualNorms norms = ResidualReduction::identity;
+  for(int c = b_rect.lo[1]; c <= b_rect.hi[1]; c++) {
+    for(int i = b_rect.lo[0]; i <= b_rect.hi[0]; i++) {
+      double r = bb.at(i, c);
+      for(int j = 0; j < n; j++) {
+        const double a = packed_at(packed, b, i, j);
+        r -= a * xb.at(j, c);
+        if(c == b_rect.lo[1])
+          norms.a_sq += a * a;
+      }
+      norms.r_sq += r * r;
+      norms.b_sq += bb.at(i, c) * bb.at(i, c);
+      norms.x_sq += xb.at(i, c) * xb.at(i, c);
+      norms.r_max = std::max(norms.r_max, fabs(r));
+    }
+  }
+  return norms;
+}
+
+/*
+ * Solves L y = b forward over the tile rows, or L^T x = y backward when
+ * transpose, in place in solve_lr. The diagonal solve of the last tile row
+ * reached is the last task of the sweep; its future is returned.
+ */
+static Future cholesky_sweep(Context ctx, HighLevelRuntime *runtime,
+                             const TileMap &map, const PackedTiles &tiles,
+                             LogicalRegion solve_lr, LogicalPartition solve_lp,
+                             bool transpose)
+{
+  const int nt = tiles.num_tiles;
+  CholArgs args;
+  args.tiles = tiles;
+  args.transpose = transpose;
+  Future last_f;
+
+  for(int step = 0; step < nt; step++) {
+    const int i = transpose ? (nt - 1 - step) : step;
+    LogicalRegion solve_block = runtime->get_logical_subregion_by_color(ctx, solve_lp, i);
+
+    args.ti = args.tj = args.tk = i;
+    TaskLauncher solve_launcher = tile_launcher(map, CHOL_SOLVE_TASK_ID,
+                                                TaskArgument(&args, sizeof(args)), i, i);
+    add_tile(solve_launcher, map, i, i, READ_ONLY);
+    solve_launcher.add_region_requirement(
+      RegionRequirement(solve_block, READ_WRITE, EXCLUSIVE, solve_lr));
+    solve_launcher.add_field(1, FID_SOLVE);
+    last_f = runtime->execute_task(ctx, solve_launcher);
+
+    // Forward: blocks j > i through L(j,i). Backward: blocks j < i through L(i,j)^T.
+    const int lo = transpose ? 0 : (i + 1);
+    const int hi = transpose ? (i - 1) : (nt - 1);
+    for(int j = lo; j <= hi; j++) {
+      args.ti = transpose ? i : j;
+      args.tj = transpose ? j : i;
+      TaskLauncher update_launcher = tile_launcher(map, CHOL_UPDATE_TASK_ID,
+                                                   TaskArgument(&args, sizeof(args)),
+                                                   args.ti, args.tj);
+      add_tile(update_launcher, map, args.ti, args.tj, READ_ONLY);
+      update_launcher.add_region_requirement(
+        RegionRequirement(runtime->get_logical_subregion_by_color(ctx, solve_lp, j),
+                          READ_WRITE, EXCLUSIVE, solve_lr));
+      update_launcher.add_field(1, FID_SOLVE);
+      update_launcher.add_region_requirement(
+        RegionRequirement(solve_block, READ_ONLY, EXCLUSIVE, solve_lr));
+      update_launcher.add_field(2, FID_SOLVE);
+      runtime->execute_task(ctx, update_launcher);
+    }
+  }
+  return last_f;
+}
+
+void cholesky_solve(Context ctx, HighLevelRuntime *runtime, int n, int nrhs,
+                    int num_batches, int tile_size, ProcessGrid grid,
+                    unsigned long long seed, const MatrixFile *matrix_file,
+                    const MatrixFile *rhs_file, const char *out_path, bool verify)
+{
+  const int b = tile_size;
+  const int nt = (n + b - 1) / b;
+  const long num_packed = packed_tile(nt, 0);
+  PackedTiles tiles = { n, b, nt };
+
+  grid = fit_grid(grid, nt);
+
+  printf("\n Solving %d x %d SPD system with %d batch(es) of %d right hand side(s): Cholesky over"
+         " %d x %d tiles of size %d, %d x %d %s grid (%s kernels, %s mapper)",
+         n, n, num_batches, nrhs, nt, nt, b, grid.rows, grid.cols,
+         grid.cyclic ? "cyclic" : "block", kernel_isa_name(), solver_mapper_name());
+  printf("\n Packed lower triangle: %.1f MB, against %.1f MB for the whole matrix",
+         num_packed * b * b * sizeof(double) / 1048576.0, (double) n * n * sizeof(double) / 1048576.0);
+
+  // Tile t is column t of the packed region
+  Rect<2> packed_rect(make_point(0, 0), make_point(b * b - 1, (int) num_packed - 1));
+  IndexSpace packed_is = runtime->create_index_space(ctx, Domain::from_rect<2>(packed_rect));
+  FieldSpace packed_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, packed_fs);
+    allocator.allocate_field(sizeof(double), FID_PACKED);
+    if(verify)
+      allocator.allocate_field(sizeof(double), FID_ORIGINAL);
+  }
+  LogicalRegion packed_lr = runtime->create_logical_region(ctx, packed_is, packed_fs);
+
+  // One partition by tile for the factorization and the sweeps, one by
+  // tile row for the launches over the rows
+  DomainColoring tile_coloring, row_coloring;
+  for(int ti = 0; ti < nt; ti++) {
+    for(int tj = 0; tj <= ti; tj++) {
+      Rect<2> tile(make_point(0, (int) packed_tile(ti, tj)),
+                   make_point(b * b - 1, (int) packed_tile(ti, tj)));
+      tile_coloring[packed_tile(ti, tj)] = Domain::from_rect<2>(tile);
+    }
+    Rect<2> tile_row(make_point(0, (int) packed_tile(ti, 0)),
+                     make_point(b * b - 1, (int) packed_tile(ti, ti)));
+    row_coloring[ti] = Domain::from_rect<2>(tile_row);
+  }
+  Rect<1> tile_colors(Point<1>(0), Point<1>((int) num_packed - 1));
+  Rect<1> row_colors(Point<1>(0), Point<1>(nt - 1));
+  Domain row_domain = Domain::from_rect<1>(row_colors);
+  IndexPartition tile_ip = runtime->create_index_partition(ctx, packed_is,
+      Domain::from_rect<1>(tile_colors), tile_coloring, true /* disjoint */);
+  IndexPartition packed_row_ip = runtime->create_index_partition(ctx, packed_is,
+      row_domain, row_coloring, true /* disjoint */);
+  LogicalPartition tile_lp = runtime->get_logical_partition(ctx, packed_lr, tile_ip);
+  LogicalPartition packed_row_lp = runtime->get_logical_partition(ctx, packed_lr, packed_row_ip);
+
+  TileMap map;
+  map.num_tiles = nt;
+  map.parent = packed_lr;
+  map.fid = FID_PACKED;
+  map.tiles.resize(nt * nt, LogicalRegion::NO_REGION);
+  map.owners.resize(nt * nt);
+  for(int ti = 0; ti < nt; ti++) {
+    for(int tj = 0; tj < nt; tj++) {
+      map.owners[ti * nt + tj] = tile_owner(grid, nt, ti, tj);
+      if(tj <= ti)
+        map.tiles[ti * nt + tj] = runtime->get_logical_subregion_by_color(ctx, tile_lp,
+                                                                          packed_tile(ti, tj));
+    }
+  }
+
+  // The RHS and solution blocks follow the tile rows
+  std::vector<int> row_lo(nt + 1);
+  for(int t = 0; t <= nt; t++)
+    row_lo[t] = std::min(t * b, n);
+
+  Rect<2> rhs_rect(make_point(0, 0), make_point(n - 1, nrhs - 1));
+  IndexSpace rhs_is = runtime->create_index_space(ctx, Domain::from_rect<2>(rhs_rect));
+  FieldSpace rhs_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, rhs_fs);
+    allocator.allocate_field(sizeof(double), FID_RHS);
+  }
+  FieldSpace solve_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, solve_fs);
+    allocator.allocate_field(sizeof(double), FID_SOLVE);
+  }
+  LogicalRegion rhs_lr = runtime->create_logical_region(ctx, rhs_is, rhs_fs);
+  LogicalRegion solve_lr = runtime->create_logical_region(ctx, rhs_is, solve_fs);
+  IndexPartition rhs_ip = create_row_blocks(ctx, runtime, rhs_is, row_lo, false);
+  LogicalPartition rhs_lp = runtime->get_logical_partition(ctx, rhs_lr, rhs_ip);
+  LogicalPartition solve_lp = runtime->get_logical_partition(ctx, solve_lr, rhs_ip);
+
+  CholArgs args;
+  args.tiles = tiles;
+  args.ti = args.tj = args.tk = 0;
+  args.transpose = false;
+  args.random.seed = seed;
+  args.random.stream = STREAM_MATRIX;
+
+  // Both inputs are read before anything is factored; a file that fails
+  // skips to the cleanup
+  bool loaded = true;
+  double ts_generate = wall_time();
+  if(matrix_file != NULL) {
+    // Loaded whole, then packed: the square matrix only lives until then
+    Rect<2> elem_rect(make_point(0, 0), make_point(n - 1, n - 1));
+    IndexSpace square_is = runtime->create_index_space(ctx, Domain::from_rect<2>(elem_rect));
+    FieldSpace square_fs = runtime->create_field_space(ctx);
+    {
+      FieldAllocator allocator = runtime->create_field_allocator(ctx, square_fs);
+      allocator.allocate_field(sizeof(double), FID_INPUT);
+    }
+    LogicalRegion square_lr = runtime->create_logical_region(ctx, square_is, square_fs);
+    IndexPartition square_ip = create_row_blocks(ctx, runtime, square_is, row_lo, true);
+    LogicalPartition square_lp = runtime->get_logical_partition(ctx, square_lr, square_ip);
+    loaded = file_blocks_loaded(load_matrix_file(ctx, runtime, *matrix_file, square_lr, square_lp,
+                                                 FID_INPUT, true /* matrix */, nt), nt);
+    if(!loaded)
+      printf("\n Loading %s failed\n", matrix_file->path);
+    else {
+      IndexLauncher pack_launcher(CHOL_PACK_TASK_ID, row_domain,
+        TaskArgument(&args, sizeof(args)), ArgumentMap());
+      pack_launcher.add_region_requirement(
+        RegionRequirement(square_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, square_lr));
+      pack_launcher.add_field(0, FID_INPUT);
+      pack_launcher.add_region_requirement(
+        RegionRequirement(packed_row_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, packed_lr));
+      pack_launcher.add_field(1, FID_PACKED);
+      runtime->execute_index_space(ctx, pack_launcher).wait_all_results();
+    }
+
+    runtime->destroy_logical_region(ctx, square_lr);
+    runtime->destroy_field_space(ctx, square_fs);
+    runtime->destroy_index_space(ctx, square_is);
+  } else {
+    IndexLauncher init_launcher(CHOL_INIT_TASK_ID, row_domain,
+      TaskArgument(&args, sizeof(args)), ArgumentMap());
+    init_launcher.add_region_requirement(
+      RegionRequirement(packed_row_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, packed_lr));
+    init_launcher.add_field(0, FID_PACKED);
+    runtime->execute_index_space(ctx, init_launcher).wait_all_results();
+  }
+  // Every batch solves the RHS of the file
+  if(loaded && (rhs_file != NULL)) {
+    loaded = file_blocks_loaded(load_matrix_file(ctx, runtime, *rhs_file, rhs_lr, rhs_lp, FID_RHS,
+                                                 false /* matrix */, nt), nt);
+    if(!loaded)
+      printf("\n Loading %s failed\n", rhs_file->path);
+  }
+
+  if(loaded) {
+    printf("\n Matrix %s: %.3f ms\n", (matrix_file != NULL) ? "loaded" : "generated",
+           (wall_time() - ts_generate) * 1e-3);
+
+    // The factorization overwrites the tiles with L
+    if(verify) {
+      CopyLauncher save_launcher;
+      save_launcher.add_copy_requirements(
+        RegionRequirement(packed_lr, READ_ONLY, EXCLUSIVE, packed_lr),
+        RegionRequirement(packed_lr, WRITE_DISCARD, EXCLUSIVE, packed_lr));
+      save_launcher.add_src_field(0, FID_PACKED);
+      save_launcher.add_dst_field(0, FID_ORIGINAL);
+      runtime->issue_copy_operation(ctx, save_launcher);
+    }
+
+    double ts_start = wall_time();
+    Future last_f;
+    for(int k = 0; k < nt; k++) {
+      args.ti = args.tj = args.tk = k;
+      TaskLauncher potrf_launcher = tile_launcher(map, CHOL_POTRF_TASK_ID,
+                                                  TaskArgument(&args, sizeof(args)), k, k);
+      add_tile(potrf_launcher, map, k, k, READ_WRITE);
+      last_f = runtime->execute_task(ctx, potrf_launcher);
+
+      for(int i = k + 1; i < nt; i++) {
+        args.ti = i;
+        args.tj = k;
+        TaskLauncher trsm_launcher = tile_launcher(map, CHOL_TRSM_TASK_ID,
+                                                   TaskArgument(&args, sizeof(args)), i, k);
+        add_tile(trsm_launcher, map, k, k, READ_ONLY);
+        add_tile(trsm_launcher, map, i, k, READ_WRITE);
+        runtime->execute_task(ctx, trsm_launcher);
+      }
+
+      for(int i = k + 1; i < nt; i++) {
+        args.ti = args.tj = i;
+        TaskLauncher syrk_launcher = tile_launcher(map, CHOL_SYRK_TASK_ID,
+                                                   TaskArgument(&args, sizeof(args)), i, i);
+        add_tile(syrk_launcher, map, i, k, READ_ONLY);
+        add_tile(syrk_launcher, map, i, i, READ_WRITE);
+        runtime->execute_task(ctx, syrk_launcher);
+
+        for(int j = k + 1; j < i; j++) {
+          args.tj = j;
+          TaskLauncher gemm_launcher = tile_launcher(map, CHOL_GEMM_TASK_ID,
+                                                     TaskArgument(&args, sizeof(args)), i, j);
+          add_tile(gemm_launcher, map, i, k, READ_ONLY);
+          add_tile(gemm_launcher, map, j, k, READ_ONLY);
+          add_tile(gemm_launcher, map, i, j, READ_WRITE);
+          runtime->execute_task(ctx, gemm_launcher);
+        }
+      }
+    }
+
+    // Every tile task feeds the last POTRF
+    last_f.get_void_result();
+    const double factor_ms = (wall_time() - ts_start) * 1e-3;
+    printf("\n Cholesky factorization: %.3f ms, %.2f GFLOP/s (n^3 / 3)\n", factor_ms,
+           (factor_ms > 0) ? ((double) n * n * n / 3.0) / (factor_ms * 1e6) : 0.0);
+
+    for(int batch = 0; batch < num_batches; batch++) {
+      double ts_batch = wall_time();
+
+      if(rhs_file == NULL) {
+        RandomArgs rhs_args = { seed, STREAM_RHS + batch };
+        IndexLauncher generate_rhs_launcher(GENERATE_RHS_TASK_ID, row_domain,
+          TaskArgument(&rhs_args, sizeof(rhs_args)), ArgumentMap());
+        generate_rhs_launcher.add_region_requirement(
+          RegionRequirement(rhs_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, rhs_lr));
+        generate_rhs_launcher.add_field(0, FID_RHS);
+        runtime->execute_index_space(ctx, generate_rhs_launcher).wait_all_results();
+      }
+      double ts_solve = wall_time();
+
+      CopyLauncher copy_launcher;
+      copy_launcher.add_copy_requirements(
+        RegionRequirement(rhs_lr, READ_ONLY, EXCLUSIVE, rhs_lr),
+        RegionRequirement(solve_lr, WRITE_DISCARD, EXCLUSIVE, solve_lr));
+      copy_launcher.add_src_field(0, FID_RHS);
+      copy_launcher.add_dst_field(0, FID_SOLVE);
+      runtime->issue_copy_operation(ctx, copy_launcher);
+
+      cholesky_sweep(ctx, runtime, map, tiles, solve_lr, solve_lp, false /* L */);
+      cholesky_sweep(ctx, runtime, map, tiles, solve_lr, solve_lp, true /* L^T */).get_void_result();
+
+      double ts_end = wall_time();
+      printf("\n Batch %d: %d RHS generated in %.3f ms, solved over %d tile rows in %.3f ms\n",
+             batch, nrhs, (ts_solve - ts_batch) * 1e-3, nt, (ts_end - ts_solve) * 1e-3);
+    }
+
+    if(verify) {
+      double ts_verify = wall_time();
+      IndexLauncher residual_launcher(CHOL_RESIDUAL_TASK_ID, row_domain,
+        TaskArgument(&args, sizeof(args)), ArgumentMap());
+      residual_launcher.add_region_requirement(
+        RegionRequirement(packed_lr, READ_ONLY, EXCLUSIVE, packed_lr));
+      residual_launcher.add_field(0, FID_ORIGINAL);
+      residual_launcher.add_region_requirement(
+        RegionRequirement(solve_lr, READ_ONLY, EXCLUSIVE, solve_lr));
+      residual_launcher.add_field(1, FID_SOLVE);
+      residual_launcher.add_region_requirement(
+        RegionRequirement(rhs_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, rhs_lr));
+      residual_launcher.add_field(2, FID_RHS);
+      ResidualNorms norms = runtime->execute_index_space(ctx, residual_launcher,
+          RESIDUAL_REDOP_ID).get_result<ResidualNorms>();
+      report_verification(norms, n, (wall_time() - ts_verify) * 1e-3);
+    }
+
+    if(out_path != NULL)
+      write_solution_file(ctx, runtime, out_path, solve_lr, solve_lp, FID_SOLVE, nt);
+  }
+
+  runtime->destroy_logical_region(ctx, rhs_lr);
+  runtime->destroy_logical_region(ctx, solve_lr);
+  runtime->destroy_logical_region(ctx, packed_lr);
+  runtime->destroy_field_space(ctx, rhs_fs);
+  runtime->destroy_field_space(ctx, solve_fs);
+  runtime->destroy_field_space(ctx, packed_fs);
+  runtime->destroy_index_space(ctx, rhs_is);
+  runtime->destroy_index_space(ctx, packed_is);
+}
+
+void register_cholesky_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<chol_init_task>
+            (CHOL_INIT_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<chol_pack_task>
+            (CHOL_PACK_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<chol_potrf_task>
+            (CHOL_POTRF_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<chol_trsm_task>
+            (CHOL_TRSM_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<chol_syrk_task>
+            (CHOL_SYRK_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<chol_gemm_task>
+            (CHOL_GEMM_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<chol_solve_task>
+            (CHOL_SOLVE_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<chol_update_task>
+            (CHOL_UPDATE_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<ResidualNorms, chol_residual_task>
+            (CHOL_RESIDUAL_TASK_ID, Processor::LOC_PROC, true, true);
+}
@@ -0,0 +1,423 @@
+#include "array_populate.h"
+
+/*
+ * Factors kept on local disk (-cache DIR), so that a later run with the
+ * same matrix maps them in instead of factoring again. The file of a
+ * matrix is named after a hash of its entries, which the row blocks
+ * compute in parallel: every row hashes its entries in column order, from
+ * a seed of its row index, and the rows add up. The sum depends neither on
+ * the layout of the matrix nor on the blocks.
+ *
+ * The file is the factors, row-major, in the element type of the engine,
+ * then the row swaps of partial pivoting when it pivots:
+ *
+ *   FactorCacheHeader | n x n doubles (floats in mixed precision) | n ints
+ *
+ * The writer sizes a temporary file, every block writes its rows at their
+ * offsets with pwrite, and the file takes its name once all of them are
+ * done, so a reader never finds a partial one. The loader maps the rows
+ * and the row swaps of each block, as the binary matrix loader does, into
+ * a field of its own: A only gets the factors once every block has read
+ * them, so a file that goes away or gets cut short is still a miss.
+ */
+
+struct FactorCacheHeader {
+  char magic[8];                // "LLSLUFAC"
+  unsigned long long hash;      // matrix_content_hash of A
+  int n;
+  int elem_size;                // sizeof(double), or sizeof(float) in mixed precision
+  int pivoted;                  // whether the row swaps follow the factors
+  int tiled;                    // the engine that computed the factors
+};
+
+struct FactorCacheArgs {
+  char path[256];
+  int n;
+  int elem_size;
+  bool pivoted;
+};
+
+/* Bytes before row i of the factors, and before the row swaps */
+static inline long long factor_row_offset(const FactorCacheArgs &args, int i)
+{
+  return (long long) sizeof(FactorCacheHeader) + (long long) i * args.n * args.elem_size;
+}
+
+static inline long long perm_offset(const FactorCacheArgs &args)
+{
+  return factor_row_offset(args, args.n);
+}
+
+static inline long long factor_file_size(const FactorCacheArgs &args)
+{
+  return perm_offset(args) + (args.pivoted ? (long long) args.n * sizeof(int) : 0);
+}
+
+unsigned long long hash_rows_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  DenseBlock block = get_matrix_block(regions[0], fid, rect);
+  const int m = rect.dim_size(0);
+
+  // One running hash per row, advanced along the layout's contiguous axis
+  std::vector<unsigned long long> h(m);
+  for(int i = 0; i < m; i++)
+    h[i] = random_mix(rect.lo[0] + i + 1);
+
+  unsigned long long bits;
+  if(block.row_stride == 1) {
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      for(int i = rect.lo[0]; i <= rect.hi[0]; i++) {
+        memcpy(&bits, &block.at(i, j), sizeof(bits));
+        h[i - rect.lo[0]] = random_mix(h[i - rect.lo[0]] ^ bits);
+      }
+  } else {
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++) {
+        memcpy(&bits, &block.at(i, j), sizeof(bits));
+        h[i - rect.lo[0]] = random_mix(h[i - rect.lo[0]] ^ bits);
+      }
+  }
+
+  unsigned long long sum = 0;
+  for(int i = 0; i < m; i++)
+    sum += h[i];
+  return sum;
+}
+
+/* Writes the factors of the rows of rect from block, one row at a time */
+template<typename T>
+static bool write_factor_rows(int fd, const FactorCacheArgs &args,
+                              const DenseBlockOf<T> &block, const Rect<2> &rect)
+{
+  std::vector<T> row(args.n);
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++) {
+    for(int j = 0; j < args.n; j++)
+      row[j] = block.at(i, j);
+    const size_t bytes = (size_t) args.n * sizeof(T);
+    if(pwrite(fd, &row[0], bytes, factor_row_offset(args, i)) != (ssize_t) bytes)
+      return false;
+  }
+  return true;
+}
+
+bool save_factors_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const FactorCacheArgs &args = *((const FactorCacheArgs *) task->args);
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  assert((rect.hi[0] < args.n) && (rect.lo[1] == 0) && (rect.hi[1] + 1 == args.n));
+
+  const int fd = open(args.path, O_WRONLY);
+  if(fd < 0)
+    return false;
+
+  bool ok;
+  if(args.elem_size == sizeof(float))
+    ok = write_factor_rows(fd, args, get_typed_matrix_block<float>(regions[0], fid, rect), rect);
+  else
+    ok = write_factor_rows(fd, args, get_matrix_block(regions[0], fid, rect), rect);
+
+  if(ok && args.pivoted) {
+    Rect<1> perm_rect = runtime->get_index_space_domain(ctx,
+        task->regions[1].region.get_index_space()).get_rect<1>();
+    const int *perm = get_dense_index_vector(regions[1], FID_PERM, perm_rect);
+    const size_t bytes = (size_t) perm_rect.dim_size(0) * sizeof(int);
+    const off_t offset = perm_offset(args) + (long long) perm_rect.lo[0] * sizeof(int);
+    ok = (pwrite(fd, perm, bytes, offset) == (ssize_t) bytes);
+  }
+  close(fd);
+
+  if(!ok)
+    printf("\n Writing factor rows %d..%d of %s failed", (int) rect.lo[0], (int) rect.hi[0], args.path);
+  return ok;
+}
+
+/*
+ * Maps bytes [begin, begin + length) of fd from the page that holds begin.
+ * Returns NULL if the mapping fails.
+ */
+static const char *map_range(int fd, long long begin, size_t length,
+                             char **base, size_t *map_length)
+{
+  const long long page = sysconf(_SC_PAGESIZE);
+  const long long map_begin = begin - (begin % page);
+  *map_length = (size_t) (begin - map_begin) + length;
+  *base = (char *) mmap(NULL, *map_length, PROT_READ, MAP_PRIVATE, fd, map_begin);
+  if(*base == MAP_FAILED)
+    return NULL;
+  return *base + (begin - map_begin);
+}
+
+template<typename T>
+static void read_factor_rows(const T *values, const FactorCacheArgs &args,
+                             const DenseBlockOf<T> &block, const Rect<2> &rect)
+{
+  if(block.row_stride == 1) {
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+        block.at(i, j) = values[(long long) (i - rect.lo[0]) * args.n + j];
+  } else {
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+        block.at(i, j) = values[(long long) (i - rect.lo[0]) * args.n + j];
+  }
+}
+
+/* Reads the rows of a block and its row swaps; false if the file fails it */
+bool load_factors_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const FactorCacheArgs &args = *((const FactorCacheArgs *) task->args);
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  assert((rect.hi[0] < args.n) && (rect.hi[1] + 1 == args.n));
+
+  // The file may have gone or changed since the lookup; a short one would
+  // fault on the pages past its end
+  const int fd = open(args.path, O_RDONLY);
+  if(fd < 0) {
+    log_solver.error("cannot open %s", args.path);
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) || (st.st_size != factor_file_size(args))) {
+    log_solver.error("%s is not the size of its factors", args.path);
+    close(fd);
+    return false;
+  }
+
+  // Only the rows of this block
+  char *base;
+  size_t map_length;
+  const void *values = map_range(fd, factor_row_offset(args, rect.lo[0]),
+      (size_t) rect.dim_size(0) * args.n * args.elem_size, &base, &map_length);
+  if(values == NULL) {
+    log_solver.error("cannot map factor rows %d..%d of %s", (int) rect.lo[0], (int) rect.hi[0],
+                     args.path);
+    close(fd);
+    return false;
+  }
+  if(args.elem_size == sizeof(float))
+    read_factor_rows((const float *) values, args,
+                     get_typed_matrix_block<float>(regions[0], fid, rect), rect);
+  else
+    read_factor_rows((const double *) values, args,
+                     get_matrix_block(regions[0], fid, rect), rect);
+  munmap(base, map_length);
+
+  if(args.pivoted) {
+    Rect<1> perm_rect = runtime->get_index_space_domain(ctx,
+        task->regions[1].region.get_index_space()).get_rect<1>();
+    int *perm = get_dense_index_vector(regions[1], FID_PERM, perm_rect);
+    const size_t bytes = (size_t) perm_rect.dim_size(0) * sizeof(int);
+    const int *swaps = (const int *) map_range(fd,
+        perm_offset(args) + (long long) perm_rect.lo[0] * sizeof(int), bytes,
+        &base, &map_length);
+    if(swaps == NULL) {
+      log_solver.error("cannot map the row swaps of %s", args.path);
+      close(fd);
+      return false;
+    }
+    memcpy(perm, swaps, bytes);
+    munmap(base, map_length);
+  }
+  close(fd);
+  return true;
+}
+
+unsigned long long matrix_content_hash(Context ctx, HighLevelRuntime *runtime,
+                                       LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                                       int num_blocks)
+{
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher hash_launcher(HASH_ROWS_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(NULL, 0), ArgumentMap());
+  hash_launcher.add_region_requirement(
+    RegionRequirement(lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, lr));
+  hash_launcher.add_field(0, fid);
+  FutureMap hash_fm = runtime->execute_index_space(ctx, hash_launcher);
+
+  unsigned long long hash = 0;
+  for(int b = 0; b < num_blocks; b++)
+    hash += hash_fm.get_result<unsigned long long>(DomainPoint::from_point<1>(Point<1>(b)));
+  return hash;
+}
+
+bool factor_cache_path(const char *dir, unsigned long long hash,
+                       const SolverOptions &options, char *path, size_t size)
+{
+  // The engines factor differently: the tiled one does not pivot, and
+  // mixed precision keeps float factors
+  const char *engine = options.tiled ? "tiled" : (options.mixed ? "mixed" : "row");
+  if(strlen(dir) + 40 >= size) {
+    printf("\n Path too long: %s", dir);
+    return false;
+  }
+  sprintf(path, "%s/%016llx-%s.lu", dir, hash, engine);
+  return true;
+}
+
+/* The arguments of the tasks for the factors of solver */
+static FactorCacheArgs factor_cache_args(const char *path, int n, const LinearSolver &solver)
+{
+  FactorCacheArgs args;
+  strcpy(args.path, path);
+  args.n = n;
+  args.elem_size = solver.solver_options().mixed ? sizeof(float) : sizeof(double);
+  args.pivoted = !solver.solver_options().tiled;
+  return args;
+}
+
+bool load_factor_cache(Context ctx, HighLevelRuntime *runtime, const char *path,
+                       unsigned long long hash, LinearSolver &solver, LogicalRegion a_lr)
+{
+  const int n = mat_rect(runtime->get_index_space_domain(ctx,
+      a_lr.get_index_space()).get_rect<2>()).dim_size(0);
+  FactorCacheArgs args;
+  if(strlen(path) >= sizeof(args.path))
+    return false;
+  args = factor_cache_args(path, n, solver);
+
+  // A file that does not match is a miss, and the next write replaces it
+  FILE *f = fopen(path, "rb");
+  if(f == NULL)
+    return false;
+  FactorCacheHeader header;
+  const bool read = (fread(&header, sizeof(header), 1, f) == 1);
+  fseek(f, 0, SEEK_END);
+  const long long file_size = ftell(f);
+  fclose(f);
+  if(!read || memcmp(header.magic, "LLSLUFAC", sizeof(header.magic)) ||
+     (header.hash != hash) || (header.n != n) || (header.elem_size != args.elem_size) ||
+     (header.pivoted != (int) args.pivoted) ||
+     (header.tiled != (int) solver.solver_options().tiled) ||
+     (file_size != factor_file_size(args))) {
+    printf("\n %s does not hold these factors, ignoring it", path);
+    return false;
+  }
+
+  LogicalRegion perm_lr = solver.attach_factors(a_lr);
+  const int num_blocks = solver.num_row_blocks();
+  FieldAllocator allocator = runtime->create_field_allocator(ctx, a_lr.get_field_space());
+  allocator.allocate_field(args.elem_size, FID_CACHE_LOAD);
+
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher load_launcher(LOAD_FACTORS_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&args, sizeof(args)), ArgumentMap());
+  load_launcher.add_region_requirement(
+    RegionRequirement(solver.factor_blocks(), 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, a_lr));
+  load_launcher.add_field(0, FID_CACHE_LOAD);
+  if(args.pivoted) {
+    LogicalPartition perm_lp = runtime->get_logical_partition(ctx, perm_lr,
+        solver.row_blocks(perm_lr.get_index_space(), false));
+    load_launcher.add_region_requirement(
+      RegionRequirement(perm_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, perm_lr));
+    load_launcher.add_field(1, FID_PERM);
+  }
+  FutureMap load_fm = runtime->execute_index_space(ctx, load_launcher);
+
+  bool ok = true;
+  for(int b = 0; b < num_blocks; b++)
+    ok = load_fm.get_result<bool>(DomainPoint::from_point<1>(Point<1>(b))) && ok;
+  if(ok) {
+    CopyLauncher copy_launcher;
+    copy_launcher.add_copy_requirements(
+      RegionRequirement(a_lr, READ_ONLY, EXCLUSIVE, a_lr),
+      RegionRequirement(a_lr, WRITE_DISCARD, EXCLUSIVE, a_lr));
+    copy_launcher.add_src_field(0, FID_CACHE_LOAD);
+    copy_launcher.add_dst_field(0, solver.factor_field());
+    runtime->issue_copy_operation(ctx, copy_launcher);
+  } else {
+    printf("\n Reading %s failed, ignoring it", path);
+    solver.detach_factors();
+  }
+  allocator.free_field(FID_CACHE_LOAD);
+  return ok;
+}
+
+bool save_factor_cache(Context ctx, HighLevelRuntime *runtime, const char *path,
+                       unsigned long long hash, LinearSolver &solver)
+{
+  LogicalRegion a_lr = solver.factors();
+  const int n = mat_rect(runtime->get_index_space_domain(ctx,
+      a_lr.get_index_space()).get_rect<2>()).dim_size(0);
+
+  FactorCacheArgs args;
+  if(strlen(path) + 4 >= sizeof(args.path)) {
+    printf("\n Path too long: %s", path);
+    return false;
+  }
+  args = factor_cache_args(path, n, solver);
+  sprintf(args.path, "%s.tmp", path);
+
+  FactorCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "LLSLUFAC", sizeof(header.magic));
+  header.hash = hash;
+  header.n = n;
+  header.elem_size = args.elem_size;
+  header.pivoted = args.pivoted;
+  header.tiled = solver.solver_options().tiled;
+
+  FILE *f = fopen(args.path, "wb");
+  if(f == NULL) {
+    printf("\n Cannot create %s", args.path);
+    return false;
+  }
+  const bool written = (fwrite(&header, sizeof(header), 1, f) == 1);
+  fclose(f);
+
+  // Sized up front, so that the blocks can write their rows in any order
+  if(!written || truncate(args.path, factor_file_size(args))) {
+    printf("\n Cannot size %s", args.path);
+    unlink(args.path);
+    return false;
+  }
+
+  const int num_blocks = solver.num_row_blocks();
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher save_launcher(SAVE_FACTORS_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&args, sizeof(args)), ArgumentMap());
+  save_launcher.add_region_requirement(
+    RegionRequirement(solver.factor_blocks(), 0 /* projection */, READ_ONLY, EXCLUSIVE, a_lr));
+  save_launcher.add_field(0, solver.factor_field());
+  if(args.pivoted) {
+    LogicalRegion perm_lr = solver.permutation();
+    LogicalPartition perm_lp = runtime->get_logical_partition(ctx, perm_lr,
+        solver.row_blocks(perm_lr.get_index_space(), false));
+    save_launcher.add_region_requirement(
+      RegionRequirement(perm_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, perm_lr));
+    save_launcher.add_field(1, FID_PERM);
+  }
+  FutureMap save_fm = runtime->execute_index_space(ctx, save_launcher);
+
+  bool ok = true;
+  for(int b = 0; b < num_blocks; b++)
+    ok = save_fm.get_result<bool>(DomainPoint::from_point<1>(Point<1>(b))) && ok;
+  if(!ok || rename(args.path, path)) {
+    unlink(args.path);
+    return false;
+  }
+  return true;
+}
+
+void register_factor_cache_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<unsigned long long, hash_rows_task>
+            (HASH_ROWS_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<bool, save_factors_task>
+            (SAVE_FACTORS_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<bool, load_factors_task>
+            (LOAD_FACTORS_TASK_ID, Processor::LOC_PROC, false, true);
+}
@@ -0,0 +1,394 @@
+#include "array_populate.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+/*
+ * Contiguous axpy (y += a * x) and dot product kernels. Every process picks
+ * the widest variant its CPU supports when it starts; -simd overrides the
+ * choice. The AVX variants are compiled with per-function target
+ * attributes, so the rest of the build needs no -mavx flags.
+ */
+
+static void axpy_scalar(double *y, const double *x, double a, int n)
+{
+  for(int i = 0; i < n; i++)
+    y[i] += a * x[i];
+}
+
+static void axpyf_scalar(float *y, const float *x, float a, int n)
+{
+  for(int i = 0; i < n; i++)
+    y[i] += a * x[i];
+}
+
+static double dot_scalar(const double *x, const double *y, int n)
+{
+  double sum = 0;
+  for(int i = 0; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(double *y, const double *x, double a, int n)
+{
+  const __m256d va = _mm256_set1_pd(a);
+  int i = 0;
+  for(; i + 4 <= n; i += 4) {
+    __m256d vy = _mm256_loadu_pd(y + i);
+    __m256d vx = _mm256_loadu_pd(x + i);
+    _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, vx, vy));
+  }
+  for(; i < n; i++)
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpyf_avx2(float *y, const float *x, float a, int n)
+{
+  const __m256 va = _mm256_set1_ps(a);
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 vx = _mm256_loadu_ps(x + i);
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, vx, vy));
+  }
+  for(; i < n; i++)
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static double dot_avx2(const double *x, const double *y, int n)
+{
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), acc0);
+    acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), acc1);
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for(; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(double *y, const double *x, double a, int n)
+{
+  const __m512d va = _mm512_set1_pd(a);
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    __m512d vy = _mm512_loadu_pd(y + i);
+    __m512d vx = _mm512_loadu_pd(x + i);
+    _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, vx, vy));
+  }
+  for(; i < n; i++)
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx512f")))
+static void axpyf_avx512(float *y, const float *x, float a, int n)
+{
+  const __m512 va = _mm512_set1_ps(a);
+  int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m512 vy = _mm512_loadu_ps(y + i);
+    __m512 vx = _mm512_loadu_ps(x + i);
+    _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, vx, vy));
+  }
+  for(; i < n; i++)
+    y[i] += a * x[i];
+}
+
+__attribute__((target("avx512f")))
+static double dot_avx512(const double *x, const double *y, int n)
+{
+  __m512d acc0 = _mm512_setzero_pd();
+  __m512d acc1 = _mm512_setzero_pd();
+  int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), acc0);
+    acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8), acc1);
+  }
+  double sum = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+  for(; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+#endif
+
+static void (*axpy_fn)(double *, const double *, double, int) = axpy_scalar;
+static void (*axpyf_fn)(float *, const float *, float, int) = axpyf_scalar;
+static double (*dot_fn)(const double *, const double *, int) = dot_scalar;
+static const char *kernel_isa = "scalar";
+
+void init_kernels(int argc, char **argv)
+{
+  const char *request = NULL;
+  for(int i = 1; i < argc - 1; i++)
+    if(!strcmp(argv[i], "-simd"))
+      request = argv[i + 1];
+
+  axpy_fn = axpy_scalar;
+  axpyf_fn = axpyf_scalar;
+  dot_fn = dot_scalar;
+  kernel_isa = "scalar";
+
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  const bool want_any = (request == NULL);
+  if((want_any || !strcmp(request, "avx512")) && __builtin_cpu_supports("avx512f")) {
+    axpy_fn = axpy_avx512;
+    axpyf_fn = axpyf_avx512;
+    dot_fn = dot_avx512;
+    kernel_isa = "avx512";
+  } else if((want_any || !strcmp(request, "avx2") || !strcmp(request, "avx512")) &&
+            __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    axpy_fn = axpy_avx2;
+    axpyf_fn = axpyf_avx2;
+    dot_fn = dot_avx2;
+    kernel_isa = "avx2";
+  }
+#endif
+}
+
+const char *kernel_isa_name(void)
+{
+  return kernel_isa;
+}
+
+void kernel_axpy(double *y, long y_stride, const double *x, long x_stride,
+                 double a, int n)
+{
+  if((y_stride == 1) && (x_stride == 1)) {
+    axpy_fn(y, x, a, n);
+    return;
+  }
+  for(int i = 0; i < n; i++)
+    y[i * y_stride] += a * x[i * x_stride];
+}
+
+void kernel_axpy(float *y, long y_stride, const float *x, long x_stride,
+                 float a, int n)
+{
+  if((y_stride == 1) && (x_stride == 1)) {
+    axpyf_fn(y, x, a, n);
+    return;
+  }
+  for(int i = 0; i < n; i++)
+    y[i * y_stride] += a * x[i * x_stride];
+}
+
+/*
+ * Double vectors against float factors, for the mixed precision solve. The
+ * products are formed in double; these run O(n^2) per solve against the
+ * O(n^3) of the float elimination, so they stay scalar.
+ */
+static void kernel_axpy(double *y, long y_stride, const float *x, long x_stride,
+                        double a, int n)
+{
+  for(int i = 0; i < n; i++)
+    y[i * y_stride] += a * x[i * x_stride];
+}
+
+static double kernel_dot(const float *x, long x_stride, const double *y, long y_stride, int n)
+{
+  double sum = 0;
+  for(int i = 0; i < n; i++)
+    sum += x[i * x_stride] * y[i * y_stride];
+  return sum;
+}
+
+double kernel_dot(const double *x, long x_stride, const double *y, long y_stride, int n)
+{
+  if((x_stride == 1) && (y_stride == 1))
+    return dot_fn(x, y, n);
+  double sum = 0;
+  for(int i = 0; i < n; i++)
+    sum += x[i * x_stride] * y[i * y_stride];
+  return sum;
+}
+
+template<typename T>
+DenseBlockOf<T> get_typed_block(const PhysicalRegion &region, FieldID fid,
+                                const Rect<2> &rect)
+{
+  RegionAccessor<AccessorType::Generic, T> acc =
+    region.get_field_accessor(fid).template typeify<T>();
+
+  Rect<2> subrect;
+  ByteOffset offsets[2];
+  DenseBlockOf<T> block;
+  block.ptr = acc.template raw_rect_ptr<2>(rect, subrect, offsets);
+  assert((block.ptr != NULL) && (subrect == rect));
+  block.row_lo = rect.lo[0];
+  block.col_lo = rect.lo[1];
+  block.row_stride = offsets[0].offset / (long) sizeof(T);
+  block.col_stride = offsets[1].offset / (long) sizeof(T);
+  return block;
+}
+
+DenseBlock get_dense_block(const PhysicalRegion &region, FieldID fid,
+                           const Rect<2> &rect)
+{
+  return get_typed_block<double>(region, fid, rect);
+}
+
+MatrixLayout matrix_layout = LAYOUT_COL_MAJOR;
+
+void init_matrix_layout(int argc, char **argv)
+{
+  matrix_layout = LAYOUT_COL_MAJOR;
+  for(int i = 1; i < argc - 1; i++) {
+    if(strcmp(argv[i], "-layout"))
+      continue;
+    if(!strcmp(argv[i + 1], "row"))
+      matrix_layout = LAYOUT_ROW_MAJOR;
+    else if(!strcmp(argv[i + 1], "tiled"))
+      matrix_layout = LAYOUT_TILED;
+    else
+      matrix_layout = LAYOUT_COL_MAJOR;
+  }
+}
+
+const char *matrix_layout_name(void)
+{
+  switch(matrix_layout) {
+    case LAYOUT_ROW_MAJOR:
+      return "row-major";
+    case LAYOUT_TILED:
+      return "tiled";
+    default:
+      return "column-major";
+  }
+}
+
+template<typename T>
+DenseBlockOf<T> get_typed_matrix_block(const PhysicalRegion &region, FieldID fid,
+                                       const Rect<2> &rect)
+{
+  DenseBlockOf<T> block = get_typed_block<T>(region, fid, mat_rect(rect));
+  if(matrix_transposed()) {
+    // The instance is indexed (col, row): swap back to (row, col)
+    std::swap(block.row_lo, block.col_lo);
+    std::swap(block.row_stride, block.col_stride);
+  }
+  return block;
+}
+
+DenseBlock get_matrix_block(const PhysicalRegion &region, FieldID fid,
+                            const Rect<2> &rect)
+{
+  return get_typed_matrix_block<double>(region, fid, rect);
+}
+
+double *get_dense_vector(const PhysicalRegion &region, FieldID fid,
+                         const Rect<1> &rect)
+{
+  RegionAccessor<AccessorType::Generic, double> acc =
+    region.get_field_accessor(fid).typeify<double>();
+
+  Rect<1> subrect;
+  ByteOffset offsets[1];
+  double *ptr = acc.raw_rect_ptr<1>(rect, subrect, offsets);
+  assert((ptr != NULL) && (subrect == rect));
+  assert(offsets[0].offset == (int) sizeof(double));
+  return ptr;
+}
+
+int *get_dense_index_vector(const PhysicalRegion &region, FieldID fid,
+                            const Rect<1> &rect)
+{
+  RegionAccessor<AccessorType::Generic, int> acc =
+    region.get_field_accessor(fid).typeify<int>();
+
+  Rect<1> subrect;
+  ByteOffset offsets[1];
+  int *ptr = acc.raw_rect_ptr<1>(rect, subrect, offsets);
+  assert((ptr != NULL) && (subrect == rect));
+  assert(offsets[0].offset == (int) sizeof(int));
+  return ptr;
+}
+
+template<typename T>
+void kernel_rank1_update(const DenseBlockOf<T> &a, int row, int col, int rows, int cols,
+                         const T *u, const T *v)
+{
+  if((rows <= 0) || (cols <= 0))
+    return;
+
+  // Walk whichever direction of the block is contiguous in memory
+  if(a.row_stride == 1) {
+    for(int j = 0; j < cols; j++)
+      kernel_axpy(&a.at(row, col + j), 1, u, 1, v[j], rows);
+  } else {
+    for(int i = 0; i < rows; i++)
+      kernel_axpy(&a.at(row + i, col), a.col_stride, v, 1, u[i], cols);
+  }
+}
+
+template<typename T>
+void kernel_gemv(const DenseBlockOf<T> &a, int row, int col, int rows, int cols,
+                 double alpha, const double *x, double *y)
+{
+  if((rows <= 0) || (cols <= 0))
+    return;
+
+  if(a.row_stride == 1) {
+    for(int j = 0; j < cols; j++)
+      kernel_axpy(y, 1, &a.at(row, col + j), 1, alpha * x[j], rows);
+  } else {
+    for(int i = 0; i < rows; i++)
+      y[i] += alpha * kernel_dot(&a.at(row + i, col), a.col_stride, x, 1, cols);
+  }
+}
+
+template<typename T>
+void kernel_unit_lower_solve(const DenseBlockOf<T> &a, int row, int m, double *x)
+{
+  if(a.row_stride == 1) {
+    for(int j = 0; j < m - 1; j++)
+      kernel_axpy(x + j + 1, 1, &a.at(row + j + 1, row + j), 1, -x[j], m - j - 1);
+  } else {
+    for(int i = 1; i < m; i++)
+      x[i] -= kernel_dot(&a.at(row + i, row), a.col_stride, x, 1, i);
+  }
+}
+
+template<typename T>
+void kernel_upper_solve(const DenseBlockOf<T> &a, int row, int m, double *x)
+{
+  if(a.row_stride == 1) {
+    for(int j = m - 1; j >= 0; j--) {
+      x[j] /= a.at(row + j, row + j);
+      kernel_axpy(x, 1, &a.at(row, row + j), 1, -x[j], j);
+    }
+  } else {
+    for(int i = m - 1; i >= 0; i--) {
+      const double y = kernel_dot(&a.at(row + i, row + i + 1), a.col_stride,
+                                  x + i + 1, 1, m - i - 1);
+      x[i] = (x[i] - y) / a.at(row + i, row + i);
+    }
+  }
+}
+
+template DenseBlockOf<double> get_typed_block<double>(const PhysicalRegion &, FieldID, const Rect<2> &);
+template DenseBlockOf<float> get_typed_block<float>(const PhysicalRegion &, FieldID, const Rect<2> &);
+template DenseBlockOf<double> get_typed_matrix_block<double>(const PhysicalRegion &, FieldID, const Rect<2> &);
+template DenseBlockOf<float> get_typed_matrix_block<float>(const PhysicalRegion &, FieldID, const Rect<2> &);
+
+template void kernel_rank1_update<double>(const DenseBlock &, int, int, int, int, const double *, const double *);
+template void kernel_rank1_update<float>(const FloatBlock &, int, int, int, int, const float *, const float *);
+template void kernel_gemv<double>(const DenseBlock &, int, int, int, int, double, const double *, double *);
+template void kernel_gemv<float>(const FloatBlock &, int, int, int, int, double, const double *, double *);
+template void kernel_unit_lower_solve<double>(const DenseBlock &, int, int, double *);
+template void kernel_unit_lower_solve<float>(const FloatBlock &, int, int, double *);
+template void kernel_upper_solve<double>(const DenseBlock &, int, int, double *);
+template void kernel_upper_solve<float>(const FloatBlock &, int, int, double *);
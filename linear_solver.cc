@@ -0,0 +1,337 @@
+#include "array_populate.h"
+
+/*
+ * The dense LU solver as a class, so that any task can factor and solve
+ * without going through top_level_task. The solver owns the work regions
+ * of the row elimination (the staged pivot rows, the multipliers and the
+ * row swaps) and the row-block partitions it launches over; the matrix and
+ * the right hand sides belong to the caller.
+ */
+
+/* Every matrix takes its own trace ID: a trace replays one region set */
+static unsigned next_trace_offset = 0;
+
+LinearSolver::LinearSolver(Context ctx_, HighLevelRuntime *runtime_,
+                           const SolverOptions &options_)
+  : ctx(ctx_), runtime(runtime_), options(options_), n(0), num_blocks(0),
+    a_lr(LogicalRegion::NO_REGION), pivot_lr(LogicalRegion::NO_REGION),
+    mult_lr(LogicalRegion::NO_REGION), perm_lr(LogicalRegion::NO_REGION),
+    trace_id(0), launches(0)
+{
+  // The float factors come from the fused row elimination only
+  assert(!options.mixed || (!options.tiled && options.fused));
+  assert(options.num_blocks >= 1);
+}
+
+LinearSolver::~LinearSolver(void)
+{
+  release_factors();
+}
+
+void LinearSolver::release_factors(void)
+{
+  // perm_lr shares the index space of mult_lr, when there is one, and has
+  // its own after attach_factors(). The row blocks of a destroyed space
+  // leave the cache with it.
+  if(perm_lr != LogicalRegion::NO_REGION) {
+    runtime->destroy_logical_region(ctx, perm_lr);
+    runtime->destroy_field_space(ctx, perm_lr.get_field_space());
+    blocks.erase(perm_lr.get_index_space());
+    if(mult_lr == LogicalRegion::NO_REGION)
+      runtime->destroy_index_space(ctx, perm_lr.get_index_space());
+  }
+  if(pivot_lr != LogicalRegion::NO_REGION) {
+    blocks.erase(mult_lr.get_index_space());
+    runtime->destroy_logical_region(ctx, pivot_lr);
+    runtime->destroy_logical_region(ctx, mult_lr);
+    runtime->destroy_field_space(ctx, pivot_lr.get_field_space());
+    runtime->destroy_field_space(ctx, mult_lr.get_field_space());
+    runtime->destroy_index_space(ctx, pivot_lr.get_index_space());
+    runtime->destroy_index_space(ctx, mult_lr.get_index_space());
+  }
+  pivot_lr = mult_lr = perm_lr = LogicalRegion::NO_REGION;
+}
+
+void LinearSolver::set_matrix(LogicalRegion a)
+{
+  // The same matrix again keeps its work regions, so that the elimination
+  // issues the same launches over the same regions and replays its trace
+  if((a == a_lr) && (pivot_lr != LogicalRegion::NO_REGION)) {
+    launches = 0;
+    return;
+  }
+
+  release_factors();
+  // The blocks of the previous matrix stay with its owner, who may still
+  // launch over them; the solver only stops handing them out
+  if((a_lr != LogicalRegion::NO_REGION) && (a_lr.get_index_space() != a.get_index_space()))
+    blocks.erase(a_lr.get_index_space());
+  if((a_lr != LogicalRegion::NO_REGION) && (a_lr != a))
+    tile_maps.erase(a_lr);
+  a_lr = a;
+  n = mat_rect(runtime->get_index_space_domain(ctx,
+      a_lr.get_index_space()).get_rect<2>()).dim_size(0);
+  num_blocks = std::min(options.num_blocks, n);
+  a_lp = runtime->get_logical_partition(ctx, a_lr, row_blocks(a_lr.get_index_space(), true));
+  launches = 0;
+}
+
+LogicalRegion LinearSolver::attach_factors(LogicalRegion a)
+{
+  // The loaded row swaps get a region of their own
+  release_factors();
+  set_matrix(a);
+  if(options.tiled)
+    return perm_lr;
+
+  Rect<1> perm_rect(Point<1>(0), Point<1>(n - 1));
+  IndexSpace perm_is = runtime->create_index_space(ctx, Domain::from_rect<1>(perm_rect));
+  FieldSpace perm_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, perm_fs);
+    allocator.allocate_field(sizeof(int), FID_PERM);
+  }
+  perm_lr = runtime->create_logical_region(ctx, perm_is, perm_fs);
+  return perm_lr;
+}
+
+void LinearSolver::detach_factors(void)
+{
+  // The caller keeps the matrix and its row blocks, most likely to factor it
+  release_factors();
+  a_lr = LogicalRegion::NO_REGION;
+  n = num_blocks = 0;
+}
+
+IndexPartition LinearSolver::row_blocks(IndexSpace is, bool matrix)
+{
+  std::map<IndexSpace, IndexPartition>::const_iterator it = blocks.find(is);
+  if(it != blocks.end())
+    return it->second;
+
+  // The work regions of the elimination and the row swaps are 1D
+  Domain dom = runtime->get_index_space_domain(ctx, is);
+  int rows;
+  if(dom.get_dim() == 1)
+    rows = dom.get_rect<1>().dim_size(0);
+  else
+    rows = (matrix ? mat_rect(dom.get_rect<2>()) : dom.get_rect<2>()).dim_size(0);
+  const int num_parts = std::min(options.num_blocks, rows);
+  std::vector<int> row_lo(num_parts + 1);
+  for(int b = 0; b <= num_parts; b++)
+    row_lo[b] = (int) (((long long) rows * b) / num_parts);
+
+  IndexPartition ip = create_row_blocks(ctx, runtime, is, row_lo, matrix);
+  blocks[is] = ip;
+  return ip;
+}
+
+/*
+ * The work regions of the row elimination of the current matrix, which
+ * last until the solver moves on to another matrix.
+ */
+void LinearSolver::create_work_regions(void)
+{
+  // The rows swapped at step k are staged here, [A(p, 0..n-1) | A(k, 0..n-1)]
+  // with p the pivot row, so that the trim tasks can read the pivot while
+  // they write the blocks that hold rows k and p.
+  Rect<1> pivot_rect(Point<1>(0), Point<1>(2 * n - 1));
+  IndexSpace pivot_is = runtime->create_index_space(ctx, Domain::from_rect<1>(pivot_rect));
+  FieldSpace pivot_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, pivot_fs);
+    allocator.allocate_field(sizeof(double), FID_PIVOT);
+  }
+  pivot_lr = runtime->create_logical_region(ctx, pivot_is, pivot_fs);
+
+  // Multipliers A(i, k) / A(k, k) of the current column, one per row. They
+  // stay in a region so that the k-loop never waits on their values.
+  Rect<1> mult_rect(Point<1>(0), Point<1>(n - 1));
+  IndexSpace mult_is = runtime->create_index_space(ctx, Domain::from_rect<1>(mult_rect));
+  FieldSpace mult_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, mult_fs);
+    allocator.allocate_field(sizeof(double), FID_MULT);
+  }
+  mult_lr = runtime->create_logical_region(ctx, mult_is, mult_fs);
+
+  // Row swaps of partial pivoting: perm[k] is the row swapped with row k
+  FieldSpace perm_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, perm_fs);
+    allocator.allocate_field(sizeof(int), FID_PERM);
+  }
+  perm_lr = runtime->create_logical_region(ctx, mult_is, perm_fs);
+
+  trace_id = ELIMINATION_TRACE_ID + __sync_fetch_and_add(&next_trace_offset, 1);
+}
+
+FactorFuture LinearSolver::factor(LogicalRegion a)
+{
+  set_matrix(a);
+
+  // Both engines factor the matrix in place, PA = LU (P = I for the tiled
+  // engine, which does not pivot), and leave the RHS alone: every solve
+  // reuses the factors.
+  //
+  // The tiled engine partitions a matrix once, however often it factors it.
+  if(options.tiled) {
+    std::map<LogicalRegion, TileMap>::const_iterator it = tile_maps.find(a_lr);
+    if(it == tile_maps.end())
+      it = tile_maps.insert(std::make_pair(a_lr,
+             tile_lu_matrix(ctx, runtime, a_lr, options.tile_size, options.grid))).first;
+    return FactorFuture(tiled_lu_factor(ctx, runtime, it->second));
+  }
+
+  // In mixed precision A stays in FID_INPUT for the residuals of the
+  // refinement, and the elimination works on a float copy of it
+  const bool mixed = options.mixed;
+  const FieldID factor_fid = mixed ? FID_FACTOR : FID_INPUT;
+  if(mixed)
+    round_matrix(ctx, runtime, a_lr, a_lp, num_blocks);
+
+  if(pivot_lr == LogicalRegion::NO_REGION)
+    create_work_regions();
+  LogicalPartition mult_lp = runtime->get_logical_partition(ctx, mult_lr,
+      row_blocks(mult_lr.get_index_space(), false));
+  LogicalPartition perm_lp = runtime->get_logical_partition(ctx, perm_lr,
+      row_blocks(perm_lr.get_index_space(), false));
+
+  Rect<1> block_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain block_domain = Domain::from_rect<1>(block_bounds);
+
+  // Nothing in this loop waits on a result. The pivot of each column is
+  // a future that the launches of the step take as an argument, and Legion
+  // orders the launches through their region dependences, so searching
+  // column k + 1 only waits for the blocks below row k to apply column k.
+  //
+  // Every step also issues the same launches over the same partitions:
+  // all of the row blocks take part, and the blocks above row k find
+  // nothing to do from k alone. The runtime traces the loop, so it
+  // analyses the dependences of a step once and replays them after that.
+  FutureMap last_fm;
+  for(int k = 0;  k < (n - 1); k++) {
+
+    log_solver.spew("elimination step %d", k);
+    if(options.trace)
+      runtime->begin_trace(ctx, trace_id);
+    const Domain &launch_domain = block_domain;
+
+    /* Every block proposes its largest |A(i, k)|, the argmax picks the pivot */
+    IndexLauncher search_launcher(mixed ? PIVOT_SEARCH_SP_TASK_ID : PIVOT_SEARCH_TASK_ID,
+      launch_domain, TaskArgument(&k, sizeof(k)), ArgumentMap());
+    search_launcher.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, a_lr));
+    search_launcher.add_field(0, factor_fid);
+    Future pivot_f = runtime->execute_index_space(ctx, search_launcher, ARGMAX_REDOP_ID);
+    launches++;
+
+    /* Stage rows p and k: their owners sum them into zeroed slots */
+    runtime->fill_field<double>(ctx, pivot_lr, pivot_lr, FID_PIVOT, 0.0);
+    IndexLauncher stage_launcher(mixed ? STAGE_PIVOT_SP_TASK_ID : STAGE_PIVOT_TASK_ID,
+      launch_domain, TaskArgument(&k, sizeof(k)), ArgumentMap());
+    stage_launcher.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, a_lr));
+    stage_launcher.add_field(0, factor_fid);
+    stage_launcher.add_region_requirement(
+      RegionRequirement(pivot_lr, SUM_REDOP_ID, EXCLUSIVE, pivot_lr));
+    stage_launcher.add_field(1, FID_PIVOT);
+    stage_launcher.add_future(pivot_f);
+    runtime->execute_index_space(ctx, stage_launcher);
+    launches++;
+
+    if(options.fused) {
+      /* One pass per block: swap, compute each multiplier and apply it */
+      IndexLauncher eliminate_launcher(mixed ? ELIMINATE_BLOCK_SP_TASK_ID : ELIMINATE_BLOCK_TASK_ID,
+        launch_domain, TaskArgument(&k, sizeof(k)), ArgumentMap());
+      eliminate_launcher.add_region_requirement(
+        RegionRequirement(a_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, a_lr));
+      eliminate_launcher.add_field(0, factor_fid);
+      eliminate_launcher.add_region_requirement(
+        RegionRequirement(pivot_lr, READ_ONLY, EXCLUSIVE, pivot_lr));
+      eliminate_launcher.add_field(1, FID_PIVOT);
+      eliminate_launcher.add_region_requirement(
+        RegionRequirement(perm_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, perm_lr));
+      eliminate_launcher.add_field(2, FID_PERM);
+      eliminate_launcher.add_future(pivot_f);
+      last_fm = runtime->execute_index_space(ctx, eliminate_launcher);
+      launches++;
+      if(options.trace)
+        runtime->end_trace(ctx, trace_id);
+      continue;
+    }
+
+    /* Each block swaps its rows and writes the multipliers below the pivot */
+    IndexLauncher index_launcher_x0(GENERATE_X0_TASK_ID,
+        launch_domain, TaskArgument(&k, sizeof(k)), ArgumentMap());
+    index_launcher_x0.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, a_lr));
+    index_launcher_x0.add_field(0, FID_INPUT);
+    index_launcher_x0.add_region_requirement(
+      RegionRequirement(pivot_lr, READ_ONLY, EXCLUSIVE, pivot_lr));
+    index_launcher_x0.add_field(1, FID_PIVOT);
+    index_launcher_x0.add_region_requirement(
+      RegionRequirement(mult_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, mult_lr));
+    index_launcher_x0.add_field(2, FID_MULT);
+    index_launcher_x0.add_region_requirement(
+      RegionRequirement(perm_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, perm_lr));
+    index_launcher_x0.add_field(3, FID_PERM);
+    index_launcher_x0.add_future(pivot_f);
+    runtime->execute_index_space(ctx, index_launcher_x0);
+    launches++;
+
+    //  Go reduce the matrix. Necessary for generation of subsequent x0
+    //  generation of the next columns
+
+    IndexLauncher index_launcher_trt(TRIM_ROW_TASK_ID,
+      launch_domain, TaskArgument(&k, sizeof(k)), ArgumentMap());
+    index_launcher_trt.add_region_requirement(
+      RegionRequirement(a_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, a_lr));
+    index_launcher_trt.add_field(0, FID_INPUT);
+
+    /* the staged pivot row is shared by every point */
+    index_launcher_trt.add_region_requirement(
+      RegionRequirement(pivot_lr, READ_ONLY, EXCLUSIVE, pivot_lr));
+    index_launcher_trt.add_field(1, FID_PIVOT);
+
+    index_launcher_trt.add_region_requirement(
+      RegionRequirement(mult_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, mult_lr));
+    index_launcher_trt.add_field(2, FID_MULT);
+
+    last_fm = runtime->execute_index_space(ctx, index_launcher_trt);
+    launches++;
+    if(options.trace)
+      runtime->end_trace(ctx, trace_id);
+  }
+
+  // Every step refills pivot_lr after the previous step has read it, so
+  // the last launch completes only after all of the elimination has
+  if(n == 1)
+    return FactorFuture();
+  return FactorFuture(last_fm);
+}
+
+Future LinearSolver::solve(LogicalRegion b_lr, LogicalRegion x_lr)
+{
+  assert(a_lr != LogicalRegion::NO_REGION);
+  IndexPartition rhs_ip = row_blocks(b_lr.get_index_space(), false);
+  LogicalPartition x_lp = runtime->get_logical_partition(ctx, x_lr, rhs_ip);
+
+  if(options.mixed)
+    return refine_solve(ctx, runtime, a_lr, a_lp, perm_lr, b_lr, rhs_ip, x_lr, x_lp,
+                        num_blocks, options.tol, options.max_iters);
+  return lu_solve(ctx, runtime, a_lr, a_lp, FID_INPUT, perm_lr, b_lr,
+                  x_lr, x_lp, num_blocks);
+}
+
+void LinearSolver::register_tasks(void)
+{
+  HighLevelRuntime::register_reduction_op<ArgmaxReduction>(ARGMAX_REDOP_ID);
+  HighLevelRuntime::register_reduction_op<SumReduction>(SUM_REDOP_ID);
+  HighLevelRuntime::register_reduction_op<ResidualReduction>(RESIDUAL_REDOP_ID);
+
+  register_elimination_tasks();
+  register_tiled_lu_tasks();
+  register_block_solve_tasks();
+  register_refinement_tasks();
+}
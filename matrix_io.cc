@@ -0,0 +1,1025 @@
+#include "array_populate.h"
+
+/*
+ * Matrix and vector files. The top-level task only reads the header of a
+ * file; the data is mapped and converted by one task per row block:
+ *
+ *   binary       each block maps just the byte range of its own rows
+ *   Matrix Market
+ *                the entries are text of varying width, so one task first
+ *                indexes the lines of the file by row block (MatrixIndex),
+ *                then every block parses just the lines of its own rows
+ *
+ * The writer is the reverse. The top-level task writes the header and
+ * sizes the file, and every block writes its rows at their offsets with
+ * pwrite. Text entries have a fixed width, so their offsets are known too.
+ */
+
+struct LoadArgs {
+  MatrixFile file;
+  bool matrix;
+};
+
+struct LoadBandArgs {
+  MatrixFile file;
+  BandShape shape;
+};
+
+/* Followed by num_blocks + 1 ints, the first row of every block */
+struct IndexArgs {
+  MatrixFile file;
+  int num_blocks;
+};
+
+struct WriteArgs {
+  char path[256];
+  bool text;
+  long long data_offset;
+  int rows, cols;
+};
+
+/* "%25.17e\n": every double, with its sign and a 3 digit exponent */
+static const int TEXT_ENTRY_WIDTH = 26;
+
+/* Reads a whole line into buf, truncated to size - 1; false at end of file */
+static bool read_line(FILE *f, char *buf, int size)
+{
+  int len = 0;
+  int c;
+  while(((c = fgetc(f)) != EOF) && (c != '\n'))
+    if(len < size - 1)
+      buf[len++] = (char) c;
+  buf[len] = '\0';
+  return (c != EOF) || (len > 0);
+}
+
+static void lower_case(char *s)
+{
+  for(; *s; s++)
+    if((*s >= 'A') && (*s <= 'Z'))
+      *s = *s - 'A' + 'a';
+}
+
+static bool open_matrix_market(FILE *f, MatrixFile &file)
+{
+  char line[1024];
+  char object[64], format[64], field[64], symmetry[64];
+
+  read_line(f, line, sizeof(line));
+  if(sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s",
+            object, format, field, symmetry) != 4) {
+    printf("\n %s: malformed Matrix Market banner", file.path);
+    return false;
+  }
+  lower_case(object);
+  lower_case(format);
+  lower_case(field);
+  lower_case(symmetry);
+
+  const bool coordinate = !strcmp(format, "coordinate");
+  file.format = coordinate ? FILE_MM_COORDINATE : FILE_MM_ARRAY;
+  file.pattern = !strcmp(field, "pattern");
+  file.symmetric = !strcmp(symmetry, "symmetric");
+
+  if(strcmp(object, "matrix") || (!coordinate && strcmp(format, "array")) ||
+     (strcmp(field, "real") && strcmp(field, "double") && strcmp(field, "integer") &&
+      !(coordinate && file.pattern)) ||
+     (strcmp(symmetry, "general") && !(coordinate && file.symmetric))) {
+    printf("\n %s: unsupported Matrix Market type %s %s %s %s",
+           file.path, object, format, field, symmetry);
+    return false;
+  }
+
+  // Comments, then the size line
+  do {
+    if(!read_line(f, line, sizeof(line))) {
+      printf("\n %s: no size line", file.path);
+      return false;
+    }
+  } while((line[0] == '%') || (line[strspn(line, " \t\r")] == '\0'));
+
+  if(coordinate) {
+    if(sscanf(line, "%d %d %lld", &file.rows, &file.cols, &file.entries) != 3) {
+      printf("\n %s: malformed size line", file.path);
+      return false;
+    }
+  } else {
+    if(sscanf(line, "%d %d", &file.rows, &file.cols) != 2) {
+      printf("\n %s: malformed size line", file.path);
+      return false;
+    }
+    file.entries = (long long) file.rows * file.cols;
+  }
+  file.data_offset = ftell(f);
+  return true;
+}
+
+static bool open_binary(FILE *f, MatrixFile &file)
+{
+  BinaryHeader header;
+  if((fread(&header, sizeof(header), 1, f) != 1) ||
+     memcmp(header.magic, "LLSDENSE", sizeof(header.magic))) {
+    printf("\n %s: neither Matrix Market nor a binary matrix file", file.path);
+    return false;
+  }
+
+  struct stat st;
+  fstat(fileno(f), &st);
+  file.format = FILE_BINARY;
+  file.rows = header.rows;
+  file.cols = header.cols;
+  file.entries = (long long) header.rows * header.cols;
+  file.data_offset = sizeof(header);
+  if(st.st_size != (off_t) (file.data_offset + file.entries * (long long) sizeof(double))) {
+    printf("\n %s: size does not match its %d x %d header", file.path, file.rows, file.cols);
+    return false;
+  }
+  return true;
+}
+
+bool open_matrix_file(const char *path, MatrixFile &file)
+{
+  memset(&file, 0, sizeof(file));
+  if(strlen(path) >= sizeof(file.path)) {
+    printf("\n Path too long: %s", path);
+    return false;
+  }
+  strcpy(file.path, path);
+
+  FILE *f = fopen(path, "rb");
+  if(f == NULL) {
+    printf("\n Cannot open %s", path);
+    return false;
+  }
+
+  char banner[15];
+  const bool mm = (fread(banner, 1, 14, f) == 14) && !memcmp(banner, "%%MatrixMarket", 14);
+  rewind(f);
+  const bool ok = mm ? open_matrix_market(f, file) : open_binary(f, file);
+  fclose(f);
+
+  if(ok && ((file.rows < 1) || (file.cols < 1))) {
+    printf("\n %s: empty %d x %d matrix", path, file.rows, file.cols);
+    return false;
+  }
+  return ok;
+}
+
+/*
+ * Where the parser puts the entries: a dense block, a block of band rows,
+ * or nowhere when only the band of the matrix is wanted
+ */
+struct DenseSink {
+  DenseBlock block;
+
+  void put(int row, int col, double value) const
+  {
+    block.at(row, col) = value;
+  }
+};
+
+struct BandSink {
+  BandView view;
+  int ku;
+  long long *dropped;   // nonzeros outside the band
+
+  void put(int row, int col, double value) const
+  {
+    if((col - row >= -view.kl) && (col - row <= ku))
+      view.at(row, col) = value;
+    else if(value != 0)
+      (*dropped)++;
+  }
+};
+
+/* Gathers the entries of a block for its CSR rows */
+struct MatrixEntry {
+  int row, col;
+  double value;
+};
+
+struct EntrySink {
+  std::vector<MatrixEntry> *entries;
+
+  void put(int row, int col, double value) const
+  {
+    MatrixEntry e = { row, col, value };
+    entries->push_back(e);
+  }
+};
+
+struct BandProbe {
+  int *kl, *ku;
+
+  void put(int row, int col, double value) const
+  {
+    if(value == 0)
+      return;
+    *kl = std::max(*kl, row - col);
+    *ku = std::max(*ku, col - row);
+  }
+};
+
+/*
+ * Finds the next line of [p, end) that is not blank, without its leading
+ * blanks, as [*line, *eol). Returns the position after it, or NULL when
+ * there is none.
+ */
+static const char *next_line(const char *p, const char *end,
+                             const char **line, const char **eol)
+{
+  while(p < end) {
+    const char *e = (const char *) memchr(p, '\n', end - p);
+    if(e == NULL)
+      e = end;
+    const char *l = p;
+    p = (e < end) ? (e + 1) : end;
+    while((l < e) && ((*l == ' ') || (*l == '\t') || (*l == '\r')))
+      l++;
+    if(l < e) {
+      *line = l;
+      *eol = e;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/* Copies [line, eol) to buf as a string, truncated to 255 characters */
+static void copy_line(const char *line, const char *eol, char *buf)
+{
+  const int len = std::min((int) (eol - line), 255);
+  memcpy(buf, line, len);
+  buf[len] = '\0';
+}
+
+/* Converts the entries of [p, end) that fall in rows [row_lo, row_hi] */
+template<typename Sink>
+static void parse_matrix_market(const MatrixFile &file, const char *p, const char *end,
+                                const Sink &sink, int row_lo, int row_hi)
+{
+  char line[256];
+  const char *l, *eol;
+
+  for(long long index = 0; (index < file.entries) && (p = next_line(p, end, &l, &eol)); index++) {
+    if(file.format == FILE_MM_ARRAY) {
+      const int row = (int) (index % file.rows);
+      const int col = (int) (index / file.rows);
+      if((row < row_lo) || (row > row_hi))
+        continue;
+      copy_line(l, eol, line);
+      sink.put(row, col, strtod(line, NULL));
+      continue;
+    }
+
+    copy_line(l, eol, line);
+    char *q;
+    const int row = (int) strtol(line, &q, 10) - 1;
+    const int col = (int) strtol(q, &q, 10) - 1;
+    const bool mine = (row >= row_lo) && (row <= row_hi);
+    const bool mirror = file.symmetric && (row != col) &&
+                        (col >= row_lo) && (col <= row_hi);
+    if(!mine && !mirror)
+      continue;
+
+    const double value = file.pattern ? 1.0 : strtod(q, NULL);
+    if(mine)
+      sink.put(row, col, value);
+    if(mirror)
+      sink.put(col, row, value);
+  }
+}
+
+/*
+ * Converts the entries of rows [row_lo, row_hi] through their items of a
+ * MatrixIndex: for an array file the line of the first row in every
+ * column, for a coordinate file every entry of the rows.
+ */
+template<typename Sink>
+static void parse_indexed_entries(const MatrixFile &file, const char *base, const char *end,
+                                  const long long *items, long long count,
+                                  const Sink &sink, int row_lo, int row_hi)
+{
+  char line[256];
+  const char *l, *eol;
+
+  if(file.format == FILE_MM_ARRAY) {
+    assert(count == file.cols);
+    for(int j = 0; j < file.cols; j++) {
+      const char *p = base + items[j];
+      for(int i = row_lo; (i <= row_hi) && (p = next_line(p, end, &l, &eol)); i++) {
+        copy_line(l, eol, line);
+        sink.put(i, j, strtod(line, NULL));
+      }
+    }
+    return;
+  }
+
+  for(long long k = 0; k < count; k++) {
+    if(!next_line(base + (items[k] >> 1), end, &l, &eol))
+      continue;
+    copy_line(l, eol, line);
+    char *q;
+    const int row = (int) strtol(line, &q, 10) - 1;
+    const int col = (int) strtol(q, &q, 10) - 1;
+    const double value = file.pattern ? 1.0 : strtod(q, NULL);
+    if(items[k] & 1)
+      sink.put(col, row, value);
+    else
+      sink.put(row, col, value);
+  }
+}
+
+/* Pointer to element rect.lo of a contiguous 1D long long field */
+static long long *get_offset_vector(const PhysicalRegion &region, FieldID fid,
+                                    const Rect<1> &rect)
+{
+  RegionAccessor<AccessorType::Generic, long long> acc =
+    region.get_field_accessor(fid).typeify<long long>();
+
+  Rect<1> subrect;
+  ByteOffset offsets[1];
+  long long *ptr = acc.raw_rect_ptr<1>(rect, subrect, offsets);
+  assert((ptr != NULL) && (subrect == rect));
+  assert(offsets[0].offset == (int) sizeof(long long));
+  return ptr;
+}
+
+/*
+ * Builds the MatrixIndex of a Matrix Market file in one pass. Items of
+ * block b are items[start[b] .. start[b + 1]):
+ *
+ *   array        one per column j, the offset of the line of
+ *                (row_lo[b], j); the other rows of the block follow it
+ *   coordinate   one per entry in the rows of the block, 2 * the offset
+ *                of its line, plus 1 when the entry is the mirror
+ *                (col, row) of a symmetric one
+ *
+ * Only the row and column of the coordinate entries are converted here;
+ * the values are left to the blocks.
+ */
+bool index_file_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const IndexArgs &args = *((const IndexArgs *) task->args);
+  const MatrixFile &file = args.file;
+  const int num_blocks = args.num_blocks;
+  const int *row_lo = (const int *) ((const char *) task->args + sizeof(IndexArgs));
+
+  Rect<1> items_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  Rect<1> starts_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  long long *items = get_offset_vector(regions[0], FID_LINE_ITEM, items_rect);
+  long long *start = get_offset_vector(regions[1], FID_BLOCK_START, starts_rect);
+
+  // Every block is empty until the file has been indexed
+  for(int b = 0; b <= num_blocks; b++)
+    start[b] = 0;
+
+  const int fd = open(file.path, O_RDONLY);
+  if(fd < 0) {
+    log_solver.error("cannot open %s", file.path);
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  const size_t map_length = st.st_size;
+  const char *base = (const char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    log_solver.error("cannot map %s", file.path);
+    return false;
+  }
+
+  const char *p = base + file.data_offset, *end = base + map_length;
+  const char *l, *eol;
+  long long index = 0;
+
+  if(file.format == FILE_MM_ARRAY) {
+    // Column-major: the first row of every block comes up once per column
+    int b = 0;
+    for(; (index < file.entries) && (p = next_line(p, end, &l, &eol)); index++) {
+      const int row = (int) (index % file.rows);
+      const int col = (int) (index / file.rows);
+      if(row == 0)
+        b = 0;
+      for(; (b < num_blocks) && (row_lo[b] == row); b++)
+        items[(long long) b * file.cols + col] = l - base;
+    }
+    for(int b = 0; b <= num_blocks; b++)
+      start[b] = (long long) b * file.cols;
+  } else {
+    std::vector<std::vector<long long> > buckets(num_blocks);
+    char line[256];
+    long long skipped = 0;
+    for(; (index < file.entries) && (p = next_line(p, end, &l, &eol)); index++) {
+      copy_line(l, eol, line);
+      char *q;
+      const int row = (int) strtol(line, &q, 10) - 1;
+      const int col = (int) strtol(q, &q, 10) - 1;
+      if((row < 0) || (row >= file.rows) || (col < 0) || (col >= file.cols)) {
+        skipped++;
+        continue;
+      }
+      const long long item = (long long) (l - base) << 1;
+      buckets[std::upper_bound(row_lo, row_lo + num_blocks, row) - row_lo - 1].push_back(item);
+      if(file.symmetric && (row != col))
+        buckets[std::upper_bound(row_lo, row_lo + num_blocks, col) - row_lo - 1].push_back(item | 1);
+    }
+    if(skipped > 0)
+      log_solver.warning("%s: %lld entries outside the %d x %d matrix", file.path,
+                         skipped, file.rows, file.cols);
+
+    for(int b = 0; b < num_blocks; b++) {
+      start[b + 1] = start[b] + buckets[b].size();
+      if(!buckets[b].empty())
+        memcpy(items + start[b], &buckets[b][0], buckets[b].size() * sizeof(long long));
+    }
+  }
+  munmap((void *) base, map_length);
+
+  if(index < file.entries) {
+    log_solver.error("%s: %lld of %lld entries", file.path, index, file.entries);
+    for(int b = 0; b <= num_blocks; b++)
+      start[b] = 0;
+    return false;
+  }
+  return true;
+}
+
+/* The items of block b of an index, mapped as regions[first] and [first + 1] */
+static const long long *block_items(const Task *task, const std::vector<PhysicalRegion> &regions,
+                                    Context ctx, HighLevelRuntime *runtime, int first,
+                                    int b, long long *count)
+{
+  Rect<1> items_rect = runtime->get_index_space_domain(ctx,
+      task->regions[first].region.get_index_space()).get_rect<1>();
+  Rect<1> starts_rect = runtime->get_index_space_domain(ctx,
+      task->regions[first + 1].region.get_index_space()).get_rect<1>();
+  const long long *items = get_offset_vector(regions[first], FID_LINE_ITEM, items_rect);
+  const long long *start = get_offset_vector(regions[first + 1], FID_BLOCK_START, starts_rect);
+  *count = start[b + 1] - start[b];
+  return items + start[b];
+}
+
+/*
+ * The CSR rows of one row block of a coordinate file: the entries of its
+ * rows go to its block of the nonzero region, which the index sized, in
+ * the order of their rows and then of the file.
+ */
+bool load_csr_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const MatrixFile &file = *((const MatrixFile *) task->args);
+  Rect<1> row_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  Rect<1> nz_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  int *row_start = get_dense_index_vector(regions[0], FID_ROW_START, row_rect) - row_rect.lo[0];
+  int *row_end = get_dense_index_vector(regions[0], FID_ROW_END, row_rect) - row_rect.lo[0];
+
+  long long count;
+  const long long *items = block_items(task, regions, ctx, runtime, 2,
+                                       task->index_point.point_data[0], &count);
+  if(!task->futures[0].get_result<bool>())
+    return false;
+  assert(count == (long long) nz_rect.volume());
+
+  std::vector<MatrixEntry> entries;
+  entries.reserve(count);
+  if(count > 0) {
+    const int fd = open(file.path, O_RDONLY);
+    if(fd < 0) {
+      log_solver.error("cannot open %s", file.path);
+      return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    const size_t map_length = st.st_size;
+    const char *base = (const char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+      log_solver.error("cannot map %s", file.path);
+      return false;
+    }
+    EntrySink sink = { &entries };
+    parse_indexed_entries(file, base, base + map_length, items, count, sink,
+                          row_rect.lo[0], row_rect.hi[0]);
+    munmap((void *) base, map_length);
+  }
+
+  // Counting sort by row: row_start holds the counts, then the offsets
+  for(int i = row_rect.lo[0]; i <= row_rect.hi[0]; i++)
+    row_start[i] = 0;
+  for(size_t k = 0; k < entries.size(); k++)
+    row_start[entries[k].row]++;
+  int nz = nz_rect.lo[0];
+  for(int i = row_rect.lo[0]; i <= row_rect.hi[0]; i++) {
+    const int c = row_start[i];
+    row_start[i] = row_end[i] = nz;
+    nz += c;
+  }
+  if(entries.empty())
+    return true;
+
+  int *col_idx = get_dense_index_vector(regions[1], FID_COL_IDX, nz_rect) - nz_rect.lo[0];
+  double *value = get_dense_vector(regions[1], FID_VALUE, nz_rect) - nz_rect.lo[0];
+  for(size_t k = 0; k < entries.size(); k++) {
+    const int at = row_end[entries[k].row]++;
+    col_idx[at] = entries[k].col;
+    value[at] = entries[k].value;
+  }
+  return true;
+}
+
+bool load_block_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const LoadArgs &args = *((const LoadArgs *) task->args);
+  const MatrixFile &file = args.file;
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect;
+  DenseBlock block;
+  if(args.matrix) {
+    rect = matrix_bounds(ctx, runtime, task->regions[0]);
+    block = get_matrix_block(regions[0], fid, rect);
+  } else {
+    rect = runtime->get_index_space_domain(ctx,
+        task->regions[0].region.get_index_space()).get_rect<2>();
+    block = get_dense_block(regions[0], fid, rect);
+  }
+  assert((rect.hi[0] < file.rows) && (rect.hi[1] + 1 == file.cols));
+
+  // The file was checked by the top-level task, but may have gone since
+  const int fd = open(file.path, O_RDONLY);
+  if(fd < 0) {
+    log_solver.error("cannot open %s", file.path);
+    return false;
+  }
+
+  if(file.format == FILE_BINARY) {
+    // Only the rows of this block, from the page that holds the first one
+    const long long row_bytes = (long long) file.cols * sizeof(double);
+    const long long begin = file.data_offset + rect.lo[0] * row_bytes;
+    const long long page = sysconf(_SC_PAGESIZE);
+    const long long map_begin = begin - (begin % page);
+    const size_t map_length = (size_t) (begin - map_begin + rect.dim_size(0) * row_bytes);
+
+    char *base = (char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, map_begin);
+    if(base == MAP_FAILED) {
+      log_solver.error("cannot map rows %d..%d of %s", (int) rect.lo[0], (int) rect.hi[0],
+                       file.path);
+      close(fd);
+      return false;
+    }
+    const double *values = (const double *) (base + (begin - map_begin));
+
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+        block.at(i, j) = values[(long long) (i - rect.lo[0]) * file.cols + j];
+    munmap(base, map_length);
+  } else {
+    struct stat st;
+    fstat(fd, &st);
+    const size_t map_length = st.st_size;
+    const char *base = (const char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED) {
+      log_solver.error("cannot map %s", file.path);
+      close(fd);
+      return false;
+    }
+
+    // Coordinate files leave out the zeros
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+        block.at(i, j) = 0;
+
+    long long count;
+    const long long *items = block_items(task, regions, ctx, runtime, 1,
+                                         task->index_point.point_data[0], &count);
+    if(!task->futures[0].get_result<bool>()) {
+      munmap((void *) base, map_length);
+      close(fd);
+      return false;
+    }
+    DenseSink sink = { block };
+    parse_indexed_entries(file, base, base + map_length, items, count, sink,
+                          rect.lo[0], rect.hi[0]);
+    munmap((void *) base, map_length);
+  }
+  close(fd);
+  return true;
+}
+
+/* Fills one block of band rows, rect being (diagonal, row) */
+bool load_band_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const LoadBandArgs &args = *((const LoadBandArgs *) task->args);
+  const MatrixFile &file = args.file;
+  const BandShape &shape = args.shape;
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  const int row_lo = rect.lo[1], row_hi = rect.hi[1];
+
+  BandSink sink;
+  long long dropped = 0;
+  sink.view.block = get_dense_block(regions[0], fid, rect);
+  sink.view.kl = shape.kl;
+  sink.ku = shape.ku;
+  sink.dropped = &dropped;
+
+  // The fill-in diagonals and the corners outside the matrix stay zero
+  for(int i = row_lo; i <= row_hi; i++)
+    for(int d = rect.lo[0]; d <= rect.hi[0]; d++)
+      sink.view.block.at(d, i) = 0;
+
+  const int fd = open(file.path, O_RDONLY);
+  if(fd < 0) {
+    log_solver.error("cannot open %s", file.path);
+    return false;
+  }
+
+  if(file.format == FILE_BINARY) {
+    const long long row_bytes = (long long) file.cols * sizeof(double);
+    const long long begin = file.data_offset + row_lo * row_bytes;
+    const long long page = sysconf(_SC_PAGESIZE);
+    const long long map_begin = begin - (begin % page);
+    const size_t map_length = (size_t) (begin - map_begin + (row_hi - row_lo + 1) * row_bytes);
+
+    char *base = (char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, map_begin);
+    if(base == MAP_FAILED) {
+      log_solver.error("cannot map rows %d..%d of %s", row_lo, row_hi, file.path);
+      close(fd);
+      return false;
+    }
+    const double *values = (const double *) (base + (begin - map_begin));
+
+    for(int i = row_lo; i <= row_hi; i++)
+      for(int j = 0; j < file.cols; j++)
+        sink.put(i, j, values[(long long) (i - row_lo) * file.cols + j]);
+    munmap(base, map_length);
+  } else {
+    struct stat st;
+    fstat(fd, &st);
+    const size_t map_length = st.st_size;
+    const char *base = (const char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED) {
+      log_solver.error("cannot map %s", file.path);
+      close(fd);
+      return false;
+    }
+    long long count;
+    const long long *items = block_items(task, regions, ctx, runtime, 1,
+                                         task->index_point.point_data[0], &count);
+    if(!task->futures[0].get_result<bool>()) {
+      munmap((void *) base, map_length);
+      close(fd);
+      return false;
+    }
+    parse_indexed_entries(file, base, base + map_length, items, count, sink, row_lo, row_hi);
+    munmap((void *) base, map_length);
+  }
+  close(fd);
+
+  if(dropped > 0)
+    log_solver.warning("%s: %lld nonzeros of rows %d..%d lie outside the band",
+                       file.path, dropped, row_lo, row_hi);
+  return true;
+}
+
+bool detect_bandwidth(const MatrixFile &file, int &kl, int &ku)
+{
+  kl = ku = 0;
+  const int fd = open(file.path, O_RDONLY);
+  if(fd < 0) {
+    printf("\n Cannot open %s", file.path);
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  const size_t map_length = st.st_size;
+  const char *base = (const char *) mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    printf("\n Cannot map %s", file.path);
+    return false;
+  }
+
+  BandProbe probe = { &kl, &ku };
+  if(file.format == FILE_BINARY) {
+    const double *values = (const double *) (base + file.data_offset);
+    for(int i = 0; i < file.rows; i++)
+      for(int j = 0; j < file.cols; j++)
+        probe.put(i, j, values[(long long) i * file.cols + j]);
+  } else
+    parse_matrix_market(file, base + file.data_offset, base + map_length, probe,
+                        0, file.rows - 1);
+  munmap((void *) base, map_length);
+  return true;
+}
+
+void write_block_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const WriteArgs &args = *((const WriteArgs *) task->args);
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock block = get_dense_block(regions[0], fid, rect);
+  const int m = rect.dim_size(0);
+
+  const int fd = open(args.path, O_WRONLY);
+  if(fd < 0) {
+    printf("\n Cannot open %s for rows %d..%d", args.path, (int) rect.lo[0], (int) rect.hi[0]);
+    return;
+  }
+
+  bool ok = true;
+  if(args.text) {
+    // Column-major: the block's rows of every column are one run of lines
+    std::vector<char> buf(m * TEXT_ENTRY_WIDTH);
+    char entry[TEXT_ENTRY_WIDTH + 8];
+    for(int r = rect.lo[1]; r <= rect.hi[1]; r++) {
+      for(int i = rect.lo[0]; i <= rect.hi[0]; i++) {
+        sprintf(entry, "%25.17e\n", block.at(i, r));
+        memcpy(&buf[(i - rect.lo[0]) * TEXT_ENTRY_WIDTH], entry, TEXT_ENTRY_WIDTH);
+      }
+      const size_t bytes = (size_t) m * TEXT_ENTRY_WIDTH;
+      const off_t offset = args.data_offset +
+        ((long long) r * args.rows + rect.lo[0]) * TEXT_ENTRY_WIDTH;
+      ok = ok && (pwrite(fd, &buf[0], bytes, offset) == (ssize_t) bytes);
+    }
+  } else {
+    std::vector<double> buf((size_t) m * args.cols);
+    for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+      for(int r = rect.lo[1]; r <= rect.hi[1]; r++)
+        buf[(size_t) (i - rect.lo[0]) * args.cols + r] = block.at(i, r);
+    const size_t bytes = buf.size() * sizeof(double);
+    const off_t offset = args.data_offset +
+      (long long) rect.lo[0] * args.cols * (long long) sizeof(double);
+    ok = (pwrite(fd, &buf[0], bytes, offset) == (ssize_t) bytes);
+  }
+  close(fd);
+
+  if(!ok)
+    printf("\n Writing rows %d..%d of %s failed", (int) rect.lo[0], (int) rect.hi[0], args.path);
+}
+
+MatrixIndex index_matrix_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                              const std::vector<int> &row_lo)
+{
+  assert(file.format != FILE_BINARY);
+  const int num_blocks = row_lo.size() - 1;
+  const long long num_items = (file.format == FILE_MM_ARRAY) ?
+    (long long) num_blocks * file.cols : file.entries * (file.symmetric ? 2 : 1);
+
+  MatrixIndex index;
+  Rect<1> items_rect(Point<1>(0), Point<1>(std::max(num_items, 1LL) - 1));
+  IndexSpace items_is = runtime->create_index_space(ctx, Domain::from_rect<1>(items_rect));
+  FieldSpace items_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, items_fs);
+    allocator.allocate_field(sizeof(long long), FID_LINE_ITEM);
+  }
+  index.items_lr = runtime->create_logical_region(ctx, items_is, items_fs);
+
+  Rect<1> starts_rect(Point<1>(0), Point<1>(num_blocks));
+  IndexSpace starts_is = runtime->create_index_space(ctx, Domain::from_rect<1>(starts_rect));
+  FieldSpace starts_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, starts_fs);
+    allocator.allocate_field(sizeof(long long), FID_BLOCK_START);
+  }
+  index.starts_lr = runtime->create_logical_region(ctx, starts_is, starts_fs);
+
+  std::vector<char> buffer(sizeof(IndexArgs) + row_lo.size() * sizeof(int));
+  IndexArgs &args = *((IndexArgs *) &buffer[0]);
+  args.file = file;
+  args.num_blocks = num_blocks;
+  memcpy(&buffer[sizeof(IndexArgs)], &row_lo[0], row_lo.size() * sizeof(int));
+
+  TaskLauncher index_launcher(INDEX_FILE_TASK_ID, TaskArgument(&buffer[0], buffer.size()));
+  index_launcher.add_region_requirement(
+    RegionRequirement(index.items_lr, WRITE_DISCARD, EXCLUSIVE, index.items_lr));
+  index_launcher.add_field(0, FID_LINE_ITEM);
+  index_launcher.add_region_requirement(
+    RegionRequirement(index.starts_lr, WRITE_DISCARD, EXCLUSIVE, index.starts_lr));
+  index_launcher.add_field(1, FID_BLOCK_START);
+  index.done = runtime->execute_task(ctx, index_launcher);
+  return index;
+}
+
+void add_matrix_index(IndexLauncher &launcher, const MatrixIndex &index)
+{
+  const unsigned first = launcher.region_requirements.size();
+  launcher.add_region_requirement(
+    RegionRequirement(index.items_lr, READ_ONLY, EXCLUSIVE, index.items_lr));
+  launcher.add_field(first, FID_LINE_ITEM);
+  launcher.add_region_requirement(
+    RegionRequirement(index.starts_lr, READ_ONLY, EXCLUSIVE, index.starts_lr));
+  launcher.add_field(first + 1, FID_BLOCK_START);
+  launcher.add_future(index.done);
+}
+
+void destroy_matrix_index(Context ctx, HighLevelRuntime *runtime, const MatrixIndex &index)
+{
+  const LogicalRegion regions[2] = { index.items_lr, index.starts_lr };
+  for(int r = 0; r < 2; r++) {
+    runtime->destroy_logical_region(ctx, regions[r]);
+    runtime->destroy_field_space(ctx, regions[r].get_field_space());
+    runtime->destroy_index_space(ctx, regions[r].get_index_space());
+  }
+}
+
+std::vector<long long> matrix_index_counts(Context ctx, HighLevelRuntime *runtime,
+                                           const MatrixIndex &index)
+{
+  Rect<1> starts_rect = runtime->get_index_space_domain(ctx,
+      index.starts_lr.get_index_space()).get_rect<1>();
+  RegionRequirement starts_req(index.starts_lr, READ_ONLY, EXCLUSIVE, index.starts_lr);
+  starts_req.add_field(FID_BLOCK_START);
+  PhysicalRegion starts_region = runtime->map_region(ctx, InlineLauncher(starts_req));
+  starts_region.wait_until_valid();
+  const long long *start = get_offset_vector(starts_region, FID_BLOCK_START, starts_rect);
+
+  std::vector<long long> counts(starts_rect.dim_size(0) - 1);
+  for(size_t b = 0; b < counts.size(); b++)
+    counts[b] = start[b + 1] - start[b];
+  runtime->unmap_region(ctx, starts_region);
+  return counts;
+}
+
+FutureMap load_csr_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                        const MatrixIndex &index, LogicalRegion rows_lr, LogicalPartition rows_lp,
+                        LogicalRegion nz_lr, LogicalPartition nz_lp, int num_blocks)
+{
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher load_launcher(LOAD_CSR_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&file, sizeof(file)), ArgumentMap());
+  load_launcher.add_region_requirement(
+    RegionRequirement(rows_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, rows_lr));
+  load_launcher.add_field(0, FID_ROW_START);
+  load_launcher.add_field(0, FID_ROW_END);
+  load_launcher.add_region_requirement(
+    RegionRequirement(nz_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, nz_lr));
+  load_launcher.add_field(1, FID_COL_IDX);
+  load_launcher.add_field(1, FID_VALUE);
+  add_matrix_index(load_launcher, index);
+  return runtime->execute_index_space(ctx, load_launcher);
+}
+
+/*
+ * The first row of every block of lp, and the row count after the last.
+ * row_dim is the coordinate of the rows: 1 for band regions, else 0.
+ */
+static std::vector<int> partition_rows(Context ctx, HighLevelRuntime *runtime,
+                                       LogicalPartition lp, int num_blocks, int rows,
+                                       int row_dim, bool matrix)
+{
+  std::vector<int> row_lo(num_blocks + 1, rows);
+  for(int b = 0; b < num_blocks; b++) {
+    LogicalRegion block = runtime->get_logical_subregion_by_color(ctx, lp, b);
+    Rect<2> rect = runtime->get_index_space_domain(ctx, block.get_index_space()).get_rect<2>();
+    if(matrix)
+      rect = mat_rect(rect);
+    row_lo[b] = rect.lo[row_dim];
+  }
+  return row_lo;
+}
+
+FutureMap load_matrix_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                           LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                           bool matrix, int num_blocks)
+{
+  LoadArgs args;
+  args.file = file;
+  args.matrix = matrix;
+
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher load_launcher(LOAD_BLOCK_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&args, sizeof(args)), ArgumentMap());
+  load_launcher.add_region_requirement(
+    RegionRequirement(lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, lr));
+  load_launcher.add_field(0, fid);
+  if(file.format == FILE_BINARY)
+    return runtime->execute_index_space(ctx, load_launcher);
+
+  MatrixIndex index = index_matrix_file(ctx, runtime, file,
+      partition_rows(ctx, runtime, lp, num_blocks, file.rows, 0, matrix));
+  add_matrix_index(load_launcher, index);
+  FutureMap load_fm = runtime->execute_index_space(ctx, load_launcher);
+  destroy_matrix_index(ctx, runtime, index);
+  return load_fm;
+}
+
+bool file_blocks_loaded(const FutureMap &fm, int num_blocks)
+{
+  bool ok = true;
+  for(int b = 0; b < num_blocks; b++)
+    ok = fm.get_result<bool>(DomainPoint::from_point<1>(Point<1>(b))) && ok;
+  return ok;
+}
+
+FutureMap load_band_file(Context ctx, HighLevelRuntime *runtime, const MatrixFile &file,
+                         const BandShape &shape, LogicalRegion lr, LogicalPartition lp,
+                         FieldID fid, int num_blocks)
+{
+  LoadBandArgs args;
+  args.file = file;
+  args.shape = shape;
+
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher load_launcher(LOAD_BAND_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&args, sizeof(args)), ArgumentMap());
+  load_launcher.add_region_requirement(
+    RegionRequirement(lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, lr));
+  load_launcher.add_field(0, fid);
+  if(file.format == FILE_BINARY)
+    return runtime->execute_index_space(ctx, load_launcher);
+
+  // Band regions are (diagonal, row)
+  MatrixIndex index = index_matrix_file(ctx, runtime, file,
+      partition_rows(ctx, runtime, lp, num_blocks, file.rows, 1, false));
+  add_matrix_index(load_launcher, index);
+  FutureMap load_fm = runtime->execute_index_space(ctx, load_launcher);
+  destroy_matrix_index(ctx, runtime, index);
+  return load_fm;
+}
+
+void write_solution_file(Context ctx, HighLevelRuntime *runtime, const char *path,
+                         LogicalRegion lr, LogicalPartition lp, FieldID fid,
+                         int num_blocks)
+{
+  Rect<2> rect = runtime->get_index_space_domain(ctx, lr.get_index_space()).get_rect<2>();
+
+  WriteArgs args;
+  if(strlen(path) >= sizeof(args.path)) {
+    printf("\n Path too long: %s", path);
+    return;
+  }
+  strcpy(args.path, path);
+  const size_t len = strlen(path);
+  args.text = (len >= 4) && !strcmp(path + len - 4, ".mtx");
+  args.rows = rect.hi[0] + 1;
+  args.cols = rect.hi[1] + 1;
+
+  FILE *f = fopen(path, "wb");
+  if(f == NULL) {
+    printf("\n Cannot create %s", path);
+    return;
+  }
+  if(args.text) {
+    fprintf(f, "%%%%MatrixMarket matrix array real general\n%d %d\n", args.rows, args.cols);
+  } else {
+    BinaryHeader header;
+    memcpy(header.magic, "LLSDENSE", sizeof(header.magic));
+    header.rows = args.rows;
+    header.cols = args.cols;
+    fwrite(&header, sizeof(header), 1, f);
+  }
+  args.data_offset = ftell(f);
+  fclose(f);
+
+  // Sized up front, so that the blocks can write their rows in any order
+  const long long entry_bytes = args.text ? TEXT_ENTRY_WIDTH : (long long) sizeof(double);
+  if(truncate(path, args.data_offset + (long long) args.rows * args.cols * entry_bytes)) {
+    printf("\n Cannot size %s", path);
+    return;
+  }
+
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher write_launcher(WRITE_BLOCK_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&args, sizeof(args)), ArgumentMap());
+  write_launcher.add_region_requirement(
+    RegionRequirement(lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, lr));
+  write_launcher.add_field(0, fid);
+  runtime->execute_index_space(ctx, write_launcher);
+}
+
+void register_matrix_io_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<bool, load_block_task>
+            (LOAD_BLOCK_TASK_ID, Processor::LOC_PROC, true, true);
+  HighLevelRuntime::register_legion_task<bool, load_band_task>
+            (LOAD_BAND_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<bool, index_file_task>
+            (INDEX_FILE_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<bool, load_csr_task>
+            (LOAD_CSR_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<write_block_task>
+            (WRITE_BLOCK_TASK_ID, Processor::LOC_PROC, true, true);
+}
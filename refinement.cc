@@ -0,0 +1,273 @@
+#include "array_populate.h"
+
+/*
+ * Mixed precision solve (-precision mixed). The elimination factors a float
+ * copy of A, which halves the bytes it streams through every step, and the
+ * solution is brought back to double accuracy by iterative refinement:
+ *
+ *   x = U^-1 L^-1 P b                  float factors
+ *   r = b - A x                        double A, one index launch
+ *   d = U^-1 L^-1 P r                  float factors
+ *   x = x + d                          until ||r|| / ||b|| < tol
+ *
+ * Refinement also stops once a correction no longer halves the residual:
+ * it has then reached the accuracy the double residual allows, or the
+ * matrix is too ill-conditioned for float factors to converge at all.
+ * The residual launch sums its norms into a single future through
+ * RESIDUAL_REDOP_ID, which is the only value the top-level task waits on
+ * in every iteration.
+ *
+ * The same launch verifies a solution (-verify), on a copy of A kept from
+ * before the factorization, and then also sums the norms of A and x.
+ */
+
+/* A(block) in float */
+void round_matrix_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_inp = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_factor = *(task->regions[1].privilege_fields.begin());
+
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  DenseBlock inp = get_matrix_block(regions[0], fid_inp, rect);
+  FloatBlock factor = get_typed_matrix_block<float>(regions[1], fid_factor, rect);
+
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      factor.at(i, j) = (float) inp.at(i, j);
+}
+
+/*
+ * r(block) = b(block) - A(block, :) x, and the block's share of the norms.
+ * With a true bool argument the block also sums the squares of its rows of
+ * A, in the same pass as the product, and of its rows of x.
+ */
+ResidualNorms residual_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const bool operand_norms = (task->arglen == sizeof(bool)) && *((const bool *) task->args);
+
+  FieldID fid_inp = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_x = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[2].privilege_fields.begin());
+  FieldID fid_r = *(task->regions[3].privilege_fields.begin());
+
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> x_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<2>();
+  Rect<2> b_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<2>();
+
+  DenseBlock inp = get_matrix_block(regions[0], fid_inp, rect);
+  DenseBlock xb = get_dense_block(regions[1], fid_x, x_rect);
+  DenseBlock bb = get_dense_block(regions[2], fid_b, b_rect);
+  DenseBlock rb = get_dense_block(regions[3], fid_r, b_rect);
+
+  const int rows = b_rect.dim_size(0);
+  const int n = x_rect.dim_size(0);
+
+  ResidualNorms norms = ResidualReduction::identity;
+  std::vector<double> x(n), r(rows);
+  for(int c = b_rect.lo[1]; c <= b_rect.hi[1]; c++) {
+    for(int j = 0; j < n; j++)
+      x[j] = xb.at(x_rect.lo[0] + j, c);
+    for(int i = 0; i < rows; i++)
+      r[i] = bb.at(b_rect.lo[0] + i, c);
+
+    if(operand_norms && (c == b_rect.lo[1])) {
+      for(int i = 0; i < rows; i++) {
+        double sum = r[i];
+        for(int j = 0; j < n; j++) {
+          const double a = inp.at(b_rect.lo[0] + i, x_rect.lo[0] + j);
+          sum -= a * x[j];
+          norms.a_sq += a * a;
+        }
+        r[i] = sum;
+      }
+    } else
+      kernel_gemv(inp, b_rect.lo[0], x_rect.lo[0], rows, n, -1.0, &x[0], &r[0]);
+
+    for(int i = 0; i < rows; i++) {
+      const double b = bb.at(b_rect.lo[0] + i, c);
+      rb.at(b_rect.lo[0] + i, c) = r[i];
+      norms.r_sq += r[i] * r[i];
+      norms.b_sq += b * b;
+      norms.r_max = std::max(norms.r_max, fabs(r[i]));
+    }
+    if(operand_norms)
+      for(int i = b_rect.lo[0]; i <= b_rect.hi[0]; i++)
+        norms.x_sq += x[i - x_rect.lo[0]] * x[i - x_rect.lo[0]];
+  }
+  return norms;
+}
+
+/* x(block) += d(block) */
+void add_correction_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_d = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_x = *(task->regions[1].privilege_fields.begin());
+
+  Rect<2> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<2>();
+  DenseBlock d = get_dense_block(regions[0], fid_d, rect);
+  DenseBlock x = get_dense_block(regions[1], fid_x, rect);
+
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    for(int c = rect.lo[1]; c <= rect.hi[1]; c++)
+      x.at(i, c) += d.at(i, c);
+}
+
+void round_matrix(Context ctx, HighLevelRuntime *runtime,
+                  LogicalRegion input_lr, LogicalPartition input_lp, int num_blocks)
+{
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher round_launcher(ROUND_MATRIX_TASK_ID,
+    Domain::from_rect<1>(launch_bounds), TaskArgument(NULL, 0), ArgumentMap());
+  round_launcher.add_region_requirement(
+    RegionRequirement(input_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, input_lr));
+  round_launcher.add_field(0, FID_INPUT);
+  round_launcher.add_region_requirement(
+    RegionRequirement(input_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, input_lr));
+  round_launcher.add_field(1, FID_FACTOR);
+  runtime->execute_index_space(ctx, round_launcher);
+}
+
+/* Launches residual_task over the row blocks; the norms come reduced */
+static Future launch_residual(Context ctx, HighLevelRuntime *runtime,
+                              LogicalRegion input_lr, LogicalPartition input_lp, FieldID matrix_fid,
+                              LogicalRegion solve_lr, LogicalRegion rhs_lr, LogicalPartition rhs_lp,
+                              LogicalRegion resid_lr, LogicalPartition resid_lp,
+                              int num_blocks, bool operand_norms)
+{
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  IndexLauncher residual_launcher(RESIDUAL_TASK_ID, Domain::from_rect<1>(launch_bounds),
+    TaskArgument(&operand_norms, sizeof(operand_norms)), ArgumentMap());
+  residual_launcher.add_region_requirement(
+    RegionRequirement(input_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, input_lr));
+  residual_launcher.add_field(0, matrix_fid);
+  residual_launcher.add_region_requirement(
+    RegionRequirement(solve_lr, READ_ONLY, EXCLUSIVE, solve_lr));
+  residual_launcher.add_field(1, FID_SOLVE);
+  residual_launcher.add_region_requirement(
+    RegionRequirement(rhs_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, rhs_lr));
+  residual_launcher.add_field(2, FID_RHS);
+  residual_launcher.add_region_requirement(
+    RegionRequirement(resid_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, resid_lr));
+  residual_launcher.add_field(3, FID_RHS);
+  return runtime->execute_index_space(ctx, residual_launcher, RESIDUAL_REDOP_ID);
+}
+
+Future refine_solve(Context ctx, HighLevelRuntime *runtime,
+                    LogicalRegion input_lr, LogicalPartition input_lp,
+                    LogicalRegion perm_lr, LogicalRegion rhs_lr, IndexPartition rhs_ip,
+                    LogicalRegion solve_lr, LogicalPartition solve_lp, int num_blocks,
+                    double tol, int max_iters)
+{
+  // r has the fields of b and d those of x, so that lu_solve takes them as is
+  LogicalRegion resid_lr = runtime->create_logical_region(ctx,
+      rhs_lr.get_index_space(), rhs_lr.get_field_space());
+  LogicalRegion corr_lr = runtime->create_logical_region(ctx,
+      rhs_lr.get_index_space(), solve_lr.get_field_space());
+  LogicalPartition rhs_lp = runtime->get_logical_partition(ctx, rhs_lr, rhs_ip);
+  LogicalPartition resid_lp = runtime->get_logical_partition(ctx, resid_lr, rhs_ip);
+  LogicalPartition corr_lp = runtime->get_logical_partition(ctx, corr_lr, rhs_ip);
+
+  Rect<1> launch_bounds(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain launch_domain = Domain::from_rect<1>(launch_bounds);
+
+  double ts_start = wall_time();
+
+  lu_solve(ctx, runtime, input_lr, input_lp, FID_FACTOR, perm_lr, rhs_lr,
+           solve_lr, solve_lp, num_blocks);
+
+  int iter = 0;
+  double rel = 0, prev_rel = 0;
+  bool stagnated = false;
+  ResidualNorms norms;
+  Future norms_f;
+  while(true) {
+    norms_f = launch_residual(ctx, runtime, input_lr, input_lp, FID_INPUT,
+                                     solve_lr, rhs_lr, rhs_lp, resid_lr, resid_lp,
+                                     num_blocks, false /* operand norms */);
+
+    norms = norms_f.get_result<ResidualNorms>();
+    rel = (norms.b_sq > 0) ? sqrt(norms.r_sq / norms.b_sq) : sqrt(norms.r_sq);
+    log_solver.info("refinement %d: ||r|| / ||b|| = %e", iter, rel);
+    stagnated = (iter > 0) && (rel > 0.5 * prev_rel);
+    if((rel < tol) || stagnated || (iter >= max_iters))
+      break;
+    prev_rel = rel;
+
+    lu_solve(ctx, runtime, input_lr, input_lp, FID_FACTOR, perm_lr, resid_lr,
+             corr_lr, corr_lp, num_blocks);
+
+    IndexLauncher correct_launcher(ADD_CORRECTION_TASK_ID, launch_domain,
+      TaskArgument(NULL, 0), ArgumentMap());
+    correct_launcher.add_region_requirement(
+      RegionRequirement(corr_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, corr_lr));
+    correct_launcher.add_field(0, FID_SOLVE);
+    correct_launcher.add_region_requirement(
+      RegionRequirement(solve_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, solve_lr));
+    correct_launcher.add_field(1, FID_SOLVE);
+    runtime->execute_index_space(ctx, correct_launcher);
+    iter++;
+  }
+
+  double ts_end = wall_time();
+  printf("\n Refinement %s after %d corrections: ||r|| / ||b|| = %e, max |r_i| = %e, %.3f ms\n",
+         (rel < tol) ? "converged" : (stagnated ? "stagnated" : "stopped"), iter, rel, norms.r_max,
+         (ts_end - ts_start) * 1e-3);
+
+  runtime->destroy_logical_region(ctx, resid_lr);
+  runtime->destroy_logical_region(ctx, corr_lr);
+  return norms_f;
+}
+
+bool verify_solution(Context ctx, HighLevelRuntime *runtime,
+                     LogicalRegion input_lr, LogicalPartition input_lp, FieldID matrix_fid,
+                     LogicalRegion rhs_lr, IndexPartition rhs_ip,
+                     LogicalRegion solve_lr, int num_blocks)
+{
+  LogicalRegion resid_lr = runtime->create_logical_region(ctx,
+      rhs_lr.get_index_space(), rhs_lr.get_field_space());
+  LogicalPartition rhs_lp = runtime->get_logical_partition(ctx, rhs_lr, rhs_ip);
+  LogicalPartition resid_lp = runtime->get_logical_partition(ctx, resid_lr, rhs_ip);
+
+  double ts_start = wall_time();
+  ResidualNorms norms = launch_residual(ctx, runtime, input_lr, input_lp, matrix_fid,
+                                        solve_lr, rhs_lr, rhs_lp, resid_lr, resid_lp,
+                                        num_blocks, true /* operand norms */).get_result<ResidualNorms>();
+  double ts_end = wall_time();
+
+  const int n = runtime->get_index_space_domain(ctx,
+      rhs_lr.get_index_space()).get_rect<2>().dim_size(0);
+  runtime->destroy_logical_region(ctx, resid_lr);
+  return report_verification(norms, n, (ts_end - ts_start) * 1e-3);
+}
+
+bool report_verification(const ResidualNorms &norms, int n, double ms)
+{
+  const double scale = sqrt(norms.a_sq) * sqrt(norms.x_sq);
+  const double scaled = (scale > 0) ? sqrt(norms.r_sq) / scale : sqrt(norms.r_sq);
+  const bool passed = (scaled <= 16.0 * n * DBL_EPSILON);
+  printf("\n Verification %s: ||b - Ax||_inf = %e, ||b - Ax||_2 / (||A||_F ||x||_2) = %e"
+         " (%.1f n eps), %.3f ms\n", passed ? "passed" : "FAILED", norms.r_max, scaled,
+         scaled / (n * DBL_EPSILON), ms);
+  return passed;
+}
+
+void register_refinement_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<round_matrix_task>
+            (ROUND_MATRIX_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<ResidualNorms, residual_task>
+            (RESIDUAL_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<add_correction_task>
+            (ADD_CORRECTION_TASK_ID, Processor::LOC_PROC, true, true);
+}
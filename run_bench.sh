@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Sweeps the release build (make BENCH=1) over matrix sizes, CPU counts and
+# solver options. Every run appends its phase timings to $OUT.csv through
+# -csv, and the table is converted to $OUT.json at the end.
+#
+#   SIZES="1024 2048" CPUS="1 4" ./run_bench.sh
+#
+# OPTIONS lists the solver options, one configuration per line.
+
+BIN=${BIN:-./array_populate_bench}
+OUT=${OUT:-bench}
+SIZES=${SIZES:-"512 1024 2048 4096"}
+CPUS=${CPUS:-"1 2 4 8"}
+NRHS=${NRHS:-1}
+BATCHES=${BATCHES:-4}
+OPTIONS=${OPTIONS:-"-lu row
+-lu row -unfused
+-lu row -precision mixed
+-lu tiled -b 128
+-lu tiled -layout tiled -b 128"}
+
+if [ ! -x "$BIN" ]; then
+  echo "$BIN not found, build it with make BENCH=1" >&2
+  exit 1
+fi
+
+rm -f "$OUT.csv" "$OUT.json"
+
+for n in $SIZES; do
+  for cpus in $CPUS; do
+    echo "$OPTIONS" | while read -r opts; do
+      echo "n=$n cpus=$cpus $opts"
+      # Memory for the matrix and the factors, plus room for the runtime
+      csize=$(( (n * n * 12) / 1048576 + 512 ))
+      $BIN -n "$n" -nrhs "$NRHS" -batches "$BATCHES" $opts \
+           -ll:cpu "$cpus" -ll:csize "$csize" -csv "$OUT.csv" > /dev/null ||
+        echo "  failed" >&2
+    done
+  done
+done
+
+if [ ! -s "$OUT.csv" ]; then
+  echo "no runs completed" >&2
+  exit 1
+fi
+
+# One object per row, with the numeric columns left unquoted
+awk -F, '
+  NR == 1 { for(i = 1; i <= NF; i++) key[i] = $i; printf "[\n"; next }
+  {
+    printf "%s  {", (NR > 2) ? ",\n" : ""
+    for(i = 1; i <= NF; i++) {
+      value = ($i ~ /^-?[0-9.]+([eE][-+]?[0-9]+)?$/) ? $i : "\"" $i "\""
+      printf "%s\"%s\": %s", (i > 1) ? ", " : "", key[i], value
+    }
+    printf "}"
+  }
+  END { printf "\n]\n" }' "$OUT.csv" > "$OUT.json"
+
+echo "wrote $OUT.csv and $OUT.json"
@@ -0,0 +1,166 @@
+#include "array_populate.h"
+#include "default_mapper.h"
+
+/*
+ * Mapper for the solver's launches, on top of the default mapper:
+ *
+ *   ownership  the CPUs are numbered in processor order, and row block
+ *              (or tile) b always runs on CPU b mod #CPUs. Index launches
+ *              over the row blocks are sliced point by point, and single
+ *              tasks carry owner_tag(b), so a block's instance stays where
+ *              its owner left it from one step of the k-loop to the next.
+ *   placement  instances go to the NUMA memory of the processor that maps
+ *              them (SOCKET_MEM, with -ll:nsize), then to system memory.
+ *              Data read by every block, the staged pivot row or x, is
+ *              thus copied once per NUMA node instead of read remotely.
+ *   priority   the pivot search and staging, the diagonal solves and the
+ *              tile GETRFs and POTRFs gate everything that follows them, so
+ *              they go ahead of the trailing updates already queued.
+ */
+
+class SolverMapper : public DefaultMapper {
+public:
+  SolverMapper(Machine machine, HighLevelRuntime *rt, Processor local);
+
+  virtual void select_task_options(Task *task);
+  virtual void slice_domain(const Task *task, const Domain &domain,
+                            std::vector<DomainSplit> &slices);
+  virtual bool map_task(Task *task);
+
+private:
+  Processor owner(MappingTagID color) const
+  {
+    return cpus[color % cpus.size()];
+  }
+
+  std::vector<Processor> cpus;
+  std::map<Processor, Memory> numa_memory;
+};
+
+static bool use_solver_mapper = true;
+
+SolverMapper::SolverMapper(Machine m, HighLevelRuntime *rt, Processor local)
+  : DefaultMapper(m, rt, local)
+{
+  std::set<Processor> all_procs;
+  machine.get_all_processors(all_procs);
+  for(std::set<Processor>::const_iterator it = all_procs.begin();
+      it != all_procs.end(); it++) {
+    if(it->kind() != Processor::LOC_PROC)
+      continue;
+    cpus.push_back(*it);
+
+    // Socket memory first, then the fastest system memory
+    std::vector<Machine::ProcessorMemoryAffinity> affinities;
+    machine.get_proc_mem_affinity(affinities, *it);
+    Memory best = Memory::NO_MEMORY;
+    int best_rank = 0;
+    unsigned best_bandwidth = 0;
+    for(unsigned idx = 0; idx < affinities.size(); idx++) {
+      const Memory::Kind kind = affinities[idx].m.kind();
+      const int rank = (kind == Memory::SOCKET_MEM) ? 2 : ((kind == Memory::SYSTEM_MEM) ? 1 : 0);
+      if((rank > best_rank) ||
+         ((rank > 0) && (rank == best_rank) && (affinities[idx].bandwidth > best_bandwidth))) {
+        best = affinities[idx].m;
+        best_rank = rank;
+        best_bandwidth = affinities[idx].bandwidth;
+      }
+    }
+    numa_memory[*it] = best;
+  }
+  assert(!cpus.empty());
+}
+
+void SolverMapper::select_task_options(Task *task)
+{
+  DefaultMapper::select_task_options(task);
+
+  if(!task->is_index_space && (task->tag & OWNER_TAG))
+    task->target_proc = owner(task->tag & OWNER_COLOR_MASK);
+
+  switch(task->task_id) {
+    case PIVOT_SEARCH_TASK_ID:
+    case PIVOT_SEARCH_SP_TASK_ID:
+    case STAGE_PIVOT_TASK_ID:
+    case STAGE_PIVOT_SP_TASK_ID:
+    case SOLVE_BLOCK_TASK_ID:
+    case SOLVE_BLOCK_SP_TASK_ID:
+    case TILE_GETRF_TASK_ID:
+    case CHOL_POTRF_TASK_ID:
+    case CHOL_SOLVE_TASK_ID:
+    case BAND_GETRF_TASK_ID:
+    case BAND_SOLVE_TASK_ID:
+    case TRI_REDUCED_TASK_ID:
+      task->task_priority = 1;
+      break;
+    default:
+      task->task_priority = 0;
+      break;
+  }
+}
+
+void SolverMapper::slice_domain(const Task *task, const Domain &domain,
+                                std::vector<DomainSplit> &slices)
+{
+  // Only the launches over row block colors have owners
+  if(domain.get_dim() != 1) {
+    DefaultMapper::slice_domain(task, domain, slices);
+    return;
+  }
+
+  Rect<1> rect = domain.get_rect<1>();
+  for(GenericPointInRectIterator<1> pir(rect); pir; pir++) {
+    Rect<1> point(pir.p, pir.p);
+    slices.push_back(DomainSplit(Domain::from_rect<1>(point),
+                                 owner(pir.p[0]), false /* recurse */, false /* stealable */));
+  }
+}
+
+bool SolverMapper::map_task(Task *task)
+{
+  const bool report = DefaultMapper::map_task(task);
+
+  std::map<Processor, Memory>::const_iterator finder = numa_memory.find(task->target_proc);
+  if((finder == numa_memory.end()) || !finder->second.exists())
+    return report;
+
+  for(unsigned idx = 0; idx < task->regions.size(); idx++) {
+    RegionRequirement &req = task->regions[idx];
+    // Reduction instances are the default mapper's
+    if(req.privilege == REDUCE)
+      continue;
+    req.target_ranking.clear();
+    req.target_ranking.push_back(finder->second);
+    if(!(finder->second == local_sysmem))
+      req.target_ranking.push_back(local_sysmem);
+    req.virtual_map = false;
+    // Update the block's instance in place rather than in a fresh one
+    req.enable_WAR_optimization = false;
+    req.blocking_factor = req.max_blocking_factor;
+  }
+  return report;
+}
+
+static void create_solver_mappers(Machine machine, HighLevelRuntime *runtime,
+                                  const std::set<Processor> &local_procs)
+{
+  for(std::set<Processor>::const_iterator it = local_procs.begin();
+      it != local_procs.end(); it++)
+    runtime->replace_default_mapper(new SolverMapper(machine, runtime, *it), *it);
+}
+
+void register_solver_mapper(int argc, char **argv)
+{
+  use_solver_mapper = true;
+  for(int i = 1; i < argc - 1; i++)
+    if(!strcmp(argv[i], "-mapper"))
+      use_solver_mapper = strcmp(argv[i + 1], "default");
+
+  if(use_solver_mapper)
+    HighLevelRuntime::set_registration_callback(create_solver_mappers);
+}
+
+const char *solver_mapper_name(void)
+{
+  return use_solver_mapper ? "solver" : "default";
+}
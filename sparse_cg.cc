@@ -0,0 +1,434 @@
+#include "array_populate.h"
+
+/*
+ * Conjugate gradient over a sparse symmetric positive definite matrix in
+ * CSR form. The matrix is split into the same row blocks as the dense path:
+ *
+ *   rows_lr   one point per row, [FID_ROW_START, FID_ROW_END) into nz_lr
+ *   nz_lr     one point per nonzero, FID_COL_IDX and FID_VALUE
+ *   vec_lr    one point per row, the CG vectors x, r, p and q = A p
+ *
+ * The matrix is either the test stencil below or a coordinate Matrix
+ * Market file. Either way the row blocks count their nonzeros first, the
+ * top-level task only adds up those counts to split nz_lr, and the blocks
+ * then fill their own rows and nonzeros.
+ *
+ * Every step of an iteration is an index launch over the row blocks. The
+ * dot products come back as futures summed by SUM_REDOP_ID, and the axpy
+ * steps take them as future arguments, so the top-level task only waits
+ * on r . r to decide whether to stop.
+ */
+
+/* q(block) = A(block, :) p */
+void spmv_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  Rect<1> row_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  Rect<1> nz_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+  Rect<1> p_rect = runtime->get_index_space_domain(ctx,
+      task->regions[2].region.get_index_space()).get_rect<1>();
+
+  const int *row_start = get_dense_index_vector(regions[0], FID_ROW_START, row_rect) - row_rect.lo[0];
+  const int *row_end = get_dense_index_vector(regions[0], FID_ROW_END, row_rect) - row_rect.lo[0];
+  const int *col_idx = get_dense_index_vector(regions[1], FID_COL_IDX, nz_rect) - nz_rect.lo[0];
+  const double *value = get_dense_vector(regions[1], FID_VALUE, nz_rect) - nz_rect.lo[0];
+  const double *p = get_dense_vector(regions[2], FID_CG_P, p_rect) - p_rect.lo[0];
+  double *q = get_dense_vector(regions[3], FID_CG_Q, row_rect) - row_rect.lo[0];
+
+  for(int i = row_rect.lo[0]; i <= row_rect.hi[0]; i++) {
+    double sum = 0;
+    for(int nz = row_start[i]; nz < row_end[i]; nz++)
+      sum += value[nz] * p[col_idx[nz]];
+    q[i] = sum;
+  }
+}
+
+/* Partial dot product of two fields over one block */
+double cg_dot_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_a = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[1].privilege_fields.begin());
+  Rect<1> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+
+  const double *a = get_dense_vector(regions[0], fid_a, rect);
+  const double *b = get_dense_vector(regions[1], fid_b, rect);
+  return kernel_dot(a, 1, b, 1, rect.dim_size(0));
+}
+
+/* y += sign * (f0 / f1) x, with the scalars f0 and f1 passed as futures */
+void cg_axpy_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const double sign = *((const double *) task->args);
+  const double alpha = sign * task->futures[0].get_result<double>() /
+                       task->futures[1].get_result<double>();
+
+  FieldID fid_x = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_y = *(task->regions[1].privilege_fields.begin());
+  Rect<1> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+
+  const double *x = get_dense_vector(regions[0], fid_x, rect);
+  double *y = get_dense_vector(regions[1], fid_y, rect);
+  kernel_axpy(y, 1, x, 1, alpha, rect.dim_size(0));
+}
+
+/* p = r + (f0 / f1) p */
+void cg_xpay_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const double beta = task->futures[0].get_result<double>() /
+                      task->futures[1].get_result<double>();
+
+  Rect<1> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+
+  const double *r = get_dense_vector(regions[0], FID_CG_R, rect);
+  double *p = get_dense_vector(regions[1], FID_CG_P, rect);
+  for(int i = 0; i < rect.dim_size(0); i++)
+    p[i] = r[i] + beta * p[i];
+}
+
+/*
+ * Test matrix: the 5-point Laplacian of a w x (n / w) grid, w = sqrt(n),
+ * with the diagonal raised to 4.5 so that it is strictly diagonally dominant
+ * and therefore SPD. Fills cols/vals for row i and returns their count.
+ */
+static int stencil_row(int n, int w, int i, int *cols, double *vals)
+{
+  int count = 0;
+  if(i - w >= 0) {
+    cols[count] = i - w; vals[count++] = -1;
+  }
+  if(i % w != 0) {
+    cols[count] = i - 1; vals[count++] = -1;
+  }
+  cols[count] = i; vals[count++] = 4.5;
+  if((i + 1 < n) && ((i + 1) % w != 0)) {
+    cols[count] = i + 1; vals[count++] = -1;
+  }
+  if(i + w < n) {
+    cols[count] = i + w; vals[count++] = -1;
+  }
+  return count;
+}
+
+struct StencilArgs {
+  int n, w;
+};
+
+/* Nonzeros of the test matrix in one row block; FID_ROW_END gets the row counts */
+long long cg_count_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const StencilArgs args = *((const StencilArgs *) task->args);
+  Rect<1> row_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  int *row_end = get_dense_index_vector(regions[0], FID_ROW_END, row_rect) - row_rect.lo[0];
+
+  int cols[5];
+  double vals[5];
+  long long count = 0;
+  for(int i = row_rect.lo[0]; i <= row_rect.hi[0]; i++) {
+    row_end[i] = stencil_row(args.n, args.w, i, cols, vals);
+    count += row_end[i];
+  }
+  return count;
+}
+
+/* CSR rows of the test matrix in one row block, from their counts */
+void cg_fill_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  const StencilArgs args = *((const StencilArgs *) task->args);
+  Rect<1> row_rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  Rect<1> nz_rect = runtime->get_index_space_domain(ctx,
+      task->regions[1].region.get_index_space()).get_rect<1>();
+
+  int *row_start = get_dense_index_vector(regions[0], FID_ROW_START, row_rect) - row_rect.lo[0];
+  int *row_end = get_dense_index_vector(regions[0], FID_ROW_END, row_rect) - row_rect.lo[0];
+  int *col_idx = get_dense_index_vector(regions[1], FID_COL_IDX, nz_rect) - nz_rect.lo[0];
+  double *value = get_dense_vector(regions[1], FID_VALUE, nz_rect) - nz_rect.lo[0];
+
+  int nz = nz_rect.lo[0];
+  for(int i = row_rect.lo[0]; i <= row_rect.hi[0]; i++) {
+    assert(nz + row_end[i] <= nz_rect.hi[0] + 1);
+    row_start[i] = nz;
+    nz += stencil_row(args.n, args.w, i, col_idx + nz, value + nz);
+    row_end[i] = nz;
+  }
+  assert(nz == nz_rect.hi[0] + 1);
+}
+
+/* Starting vectors of one block: x = 0, r = p = b */
+void cg_init_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  Rect<1> rect = runtime->get_index_space_domain(ctx,
+      task->regions[0].region.get_index_space()).get_rect<1>();
+  double *x = get_dense_vector(regions[0], FID_CG_X, rect) - rect.lo[0];
+  double *r = get_dense_vector(regions[0], FID_CG_R, rect) - rect.lo[0];
+  double *p = get_dense_vector(regions[0], FID_CG_P, rect) - rect.lo[0];
+
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++) {
+    x[i] = 0;
+    r[i] = p[i] = 1 + (i % 7);
+  }
+}
+
+static Future cg_dot(Context ctx, HighLevelRuntime *runtime, Domain launch_domain,
+                     LogicalRegion vec_lr, LogicalPartition vec_lp,
+                     FieldID fid_a, FieldID fid_b)
+{
+  IndexLauncher dot_launcher(CG_DOT_TASK_ID, launch_domain, TaskArgument(NULL, 0), ArgumentMap());
+  dot_launcher.add_region_requirement(
+    RegionRequirement(vec_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, vec_lr));
+  dot_launcher.add_field(0, fid_a);
+  dot_launcher.add_region_requirement(
+    RegionRequirement(vec_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, vec_lr));
+  dot_launcher.add_field(1, fid_b);
+  return runtime->execute_index_space(ctx, dot_launcher, SUM_REDOP_ID);
+}
+
+static void cg_axpy(Context ctx, HighLevelRuntime *runtime, Domain launch_domain,
+                    LogicalRegion vec_lr, LogicalPartition vec_lp,
+                    FieldID fid_x, FieldID fid_y, double sign, Future num, Future den)
+{
+  IndexLauncher axpy_launcher(CG_AXPY_TASK_ID, launch_domain,
+    TaskArgument(&sign, sizeof(sign)), ArgumentMap());
+  axpy_launcher.add_region_requirement(
+    RegionRequirement(vec_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, vec_lr));
+  axpy_launcher.add_field(0, fid_x);
+  axpy_launcher.add_region_requirement(
+    RegionRequirement(vec_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, vec_lr));
+  axpy_launcher.add_field(1, fid_y);
+  axpy_launcher.add_future(num);
+  axpy_launcher.add_future(den);
+  runtime->execute_index_space(ctx, axpy_launcher);
+}
+
+void sparse_cg_solve(Context ctx, HighLevelRuntime *runtime, int n,
+                     const MatrixFile *matrix_file, const std::vector<int> &row_lo,
+                     double tol, int max_iters, bool dump)
+{
+  const int num_blocks = row_lo.size() - 1;
+
+  Rect<1> row_rect(Point<1>(0), Point<1>(n - 1));
+  IndexSpace row_is = runtime->create_index_space(ctx, Domain::from_rect<1>(row_rect));
+  FieldSpace rows_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, rows_fs);
+    allocator.allocate_field(sizeof(int), FID_ROW_START);
+    allocator.allocate_field(sizeof(int), FID_ROW_END);
+  }
+  LogicalRegion rows_lr = runtime->create_logical_region(ctx, row_is, rows_fs);
+
+  FieldSpace vec_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, vec_fs);
+    allocator.allocate_field(sizeof(double), FID_CG_X);
+    allocator.allocate_field(sizeof(double), FID_CG_R);
+    allocator.allocate_field(sizeof(double), FID_CG_P);
+    allocator.allocate_field(sizeof(double), FID_CG_Q);
+  }
+  LogicalRegion vec_lr = runtime->create_logical_region(ctx, row_is, vec_fs);
+
+  IndexPartition row_ip = create_row_blocks(ctx, runtime, row_is, row_lo, false);
+  LogicalPartition rows_lp = runtime->get_logical_partition(ctx, rows_lr, row_ip);
+  LogicalPartition vec_lp = runtime->get_logical_partition(ctx, vec_lr, row_ip);
+  Rect<1> color_rect(Point<1>(0), Point<1>(num_blocks - 1));
+  Domain launch_domain = Domain::from_rect<1>(color_rect);
+
+  // Nonzeros per row block, which fix the split of nz_lr
+  StencilArgs stencil;
+  stencil.n = n;
+  stencil.w = (int) sqrt((double) n);
+  MatrixIndex index;
+  std::vector<long long> counts(num_blocks);
+  if(matrix_file != NULL) {
+    index = index_matrix_file(ctx, runtime, *matrix_file, row_lo);
+    counts = matrix_index_counts(ctx, runtime, index);
+    if(!index.done.get_result<bool>()) {
+      printf("\n Indexing %s failed\n", matrix_file->path);
+      destroy_matrix_index(ctx, runtime, index);
+      return;
+    }
+  } else {
+    IndexLauncher count_launcher(CG_COUNT_TASK_ID, launch_domain,
+      TaskArgument(&stencil, sizeof(stencil)), ArgumentMap());
+    count_launcher.add_region_requirement(
+      RegionRequirement(rows_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, rows_lr));
+    count_launcher.add_field(0, FID_ROW_END);
+    FutureMap count_fm = runtime->execute_index_space(ctx, count_launcher);
+    for(int b = 0; b < num_blocks; b++)
+      counts[b] = count_fm.get_result<long long>(DomainPoint::from_point<1>(Point<1>(b)));
+  }
+
+  // Block b holds the nonzeros of its rows, which are contiguous in CSR
+  std::vector<long long> nz_lo(num_blocks + 1, 0);
+  for(int b = 0; b < num_blocks; b++)
+    nz_lo[b + 1] = nz_lo[b] + counts[b];
+  const long long nnz = nz_lo[num_blocks];
+  if((nnz == 0) || (nnz > INT_MAX)) {
+    printf("\n CG needs between 1 and %d nonzeros, not %lld\n", INT_MAX, nnz);
+    if(matrix_file != NULL)
+      destroy_matrix_index(ctx, runtime, index);
+    return;
+  }
+
+  printf("\n Solving %d x %d sparse system (%lld nonzeros) with CG over %d row blocks",
+         n, n, nnz, num_blocks);
+
+  Rect<1> nz_rect(Point<1>(0), Point<1>(nnz - 1));
+  IndexSpace nz_is = runtime->create_index_space(ctx, Domain::from_rect<1>(nz_rect));
+  FieldSpace nz_fs = runtime->create_field_space(ctx);
+  {
+    FieldAllocator allocator = runtime->create_field_allocator(ctx, nz_fs);
+    allocator.allocate_field(sizeof(int), FID_COL_IDX);
+    allocator.allocate_field(sizeof(double), FID_VALUE);
+  }
+  LogicalRegion nz_lr = runtime->create_logical_region(ctx, nz_is, nz_fs);
+
+  DomainColoring nz_coloring;
+  for(int b = 0; b < num_blocks; b++) {
+    Rect<1> block(Point<1>(nz_lo[b]), Point<1>(nz_lo[b + 1] - 1));
+    nz_coloring[b] = Domain::from_rect<1>(block);
+  }
+  IndexPartition nz_ip = runtime->create_index_partition(ctx, nz_is,
+      launch_domain, nz_coloring, true /* disjoint */);
+  LogicalPartition nz_lp = runtime->get_logical_partition(ctx, nz_lr, nz_ip);
+
+  // Fill the CSR arrays and the starting vectors block by block
+  if(matrix_file != NULL) {
+    FutureMap load_fm = load_csr_file(ctx, runtime, *matrix_file, index,
+                                      rows_lr, rows_lp, nz_lr, nz_lp, num_blocks);
+    const bool loaded = file_blocks_loaded(load_fm, num_blocks);
+    destroy_matrix_index(ctx, runtime, index);
+    if(!loaded) {
+      printf("\n Loading %s failed\n", matrix_file->path);
+      return;
+    }
+  } else {
+    IndexLauncher fill_launcher(CG_FILL_TASK_ID, launch_domain,
+      TaskArgument(&stencil, sizeof(stencil)), ArgumentMap());
+    fill_launcher.add_region_requirement(
+      RegionRequirement(rows_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, rows_lr));
+    fill_launcher.add_field(0, FID_ROW_START);
+    fill_launcher.add_field(0, FID_ROW_END);
+    fill_launcher.add_region_requirement(
+      RegionRequirement(nz_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, nz_lr));
+    fill_launcher.add_field(1, FID_COL_IDX);
+    fill_launcher.add_field(1, FID_VALUE);
+    runtime->execute_index_space(ctx, fill_launcher);
+  }
+
+  IndexLauncher init_launcher(CG_INIT_TASK_ID, launch_domain, TaskArgument(NULL, 0), ArgumentMap());
+  init_launcher.add_region_requirement(
+    RegionRequirement(vec_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, vec_lr));
+  init_launcher.add_field(0, FID_CG_X);
+  init_launcher.add_field(0, FID_CG_R);
+  init_launcher.add_field(0, FID_CG_P);
+  runtime->execute_index_space(ctx, init_launcher);
+
+  double ts_start = wall_time();
+
+  Future rr = cg_dot(ctx, runtime, launch_domain, vec_lr, vec_lp, FID_CG_R, FID_CG_R);
+  const double bb = rr.get_result<double>();
+  double rr_value = bb;
+  int iter = 0;
+
+  while((iter < max_iters) && (rr_value > tol * tol * bb)) {
+    IndexLauncher spmv_launcher(SPMV_TASK_ID, launch_domain, TaskArgument(NULL, 0), ArgumentMap());
+    spmv_launcher.add_region_requirement(
+      RegionRequirement(rows_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, rows_lr));
+    spmv_launcher.add_field(0, FID_ROW_START);
+    spmv_launcher.add_field(0, FID_ROW_END);
+    spmv_launcher.add_region_requirement(
+      RegionRequirement(nz_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, nz_lr));
+    spmv_launcher.add_field(1, FID_COL_IDX);
+    spmv_launcher.add_field(1, FID_VALUE);
+    spmv_launcher.add_region_requirement(
+      RegionRequirement(vec_lr, READ_ONLY, EXCLUSIVE, vec_lr));
+    spmv_launcher.add_field(2, FID_CG_P);
+    spmv_launcher.add_region_requirement(
+      RegionRequirement(vec_lp, 0 /* projection */, WRITE_DISCARD, EXCLUSIVE, vec_lr));
+    spmv_launcher.add_field(3, FID_CG_Q);
+    runtime->execute_index_space(ctx, spmv_launcher);
+
+    // alpha = (r . r) / (p . q)
+    Future pq = cg_dot(ctx, runtime, launch_domain, vec_lr, vec_lp, FID_CG_P, FID_CG_Q);
+    cg_axpy(ctx, runtime, launch_domain, vec_lr, vec_lp, FID_CG_P, FID_CG_X, 1.0, rr, pq);
+    cg_axpy(ctx, runtime, launch_domain, vec_lr, vec_lp, FID_CG_Q, FID_CG_R, -1.0, rr, pq);
+
+    // beta = (r . r)_new / (r . r)
+    Future rr_new = cg_dot(ctx, runtime, launch_domain, vec_lr, vec_lp, FID_CG_R, FID_CG_R);
+    IndexLauncher xpay_launcher(CG_XPAY_TASK_ID, launch_domain, TaskArgument(NULL, 0), ArgumentMap());
+    xpay_launcher.add_region_requirement(
+      RegionRequirement(vec_lp, 0 /* projection */, READ_ONLY, EXCLUSIVE, vec_lr));
+    xpay_launcher.add_field(0, FID_CG_R);
+    xpay_launcher.add_region_requirement(
+      RegionRequirement(vec_lp, 0 /* projection */, READ_WRITE, EXCLUSIVE, vec_lr));
+    xpay_launcher.add_field(1, FID_CG_P);
+    xpay_launcher.add_future(rr_new);
+    xpay_launcher.add_future(rr);
+    runtime->execute_index_space(ctx, xpay_launcher);
+
+    rr = rr_new;
+    rr_value = rr.get_result<double>();
+    iter++;
+  }
+
+  double ts_end = wall_time();
+  printf("\n CG %s after %d iterations: ||r|| / ||b|| = %e, %.3f ms\n",
+         (rr_value <= tol * tol * bb) ? "converged" : "stopped", iter,
+         sqrt(rr_value / bb), (ts_end - ts_start) * 1e-3);
+
+  if(!dump)
+    return;
+
+  RegionRequirement x_req(vec_lr, READ_ONLY, EXCLUSIVE, vec_lr);
+  x_req.add_field(FID_CG_X);
+  PhysicalRegion x_region = runtime->map_region(ctx, InlineLauncher(x_req));
+  x_region.wait_until_valid();
+  const double *x = get_dense_vector(x_region, FID_CG_X, row_rect);
+  printf("\n\n The Solution: \n");
+  for(int i = 0; i < n; i++)
+    printf(" %lf\n", x[i]);
+  runtime->unmap_region(ctx, x_region);
+}
+
+void register_sparse_cg_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<spmv_task>
+            (SPMV_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<double, cg_dot_task>
+            (CG_DOT_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<cg_axpy_task>
+            (CG_AXPY_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<cg_xpay_task>
+            (CG_XPAY_TASK_ID, Processor::LOC_PROC, true, true);
+
+  HighLevelRuntime::register_legion_task<long long, cg_count_task>
+            (CG_COUNT_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<cg_fill_task>
+            (CG_FILL_TASK_ID, Processor::LOC_PROC, false, true);
+
+  HighLevelRuntime::register_legion_task<cg_init_task>
+            (CG_INIT_TASK_ID, Processor::LOC_PROC, false, true);
+}
@@ -0,0 +1,402 @@
+#include "array_populate.h"
+
+/*
+ * Right-looking tiled LU without pivoting, so only for matrices that are
+ * safe to factor without it, such as diagonally dominant ones; the
+ * generator makes its matrix so for this engine. A zero or tiny pivot is
+ * logged. For every diagonal tile k:
+ *
+ *   GETRF  A(k,k) = L(k,k) U(k,k)
+ *   TRSM_L A(k,j) = L(k,k)^-1 A(k,j)            j > k
+ *   TRSM_U A(i,k) = A(i,k) U(k,k)^-1            i > k
+ *   GEMM   A(i,j) = A(i,j) - A(i,k) A(k,j)      i, j > k
+ *
+ * Every operation is its own task on tile subregions, so Legion extracts
+ * the parallelism of the task graph from the region dependences. The
+ * factors overwrite the matrix: L below the diagonal (unit diagonal not
+ * stored), U on and above it.
+ *
+ * The tiles are distributed over a P x Q grid of owners, 2D block-cyclic
+ * by default. The matrix is first partitioned into one piece per owner,
+ * each the union of the owner's tiles, then every piece into its tiles,
+ * and every tile task runs on the owner of the tile it writes. Cyclic
+ * owners keep tiles all the way into the trailing matrix, where a
+ * contiguous split leaves the owners of the top and left tiles idle.
+ */
+
+/*
+ * Row-major view of a tile, element (i, j) at ptr[i * ld + j]. A tile whose
+ * instance is already row-major is used in place; any other layout is
+ * staged through a dense copy, so the kernels below always stream rows.
+ */
+struct TileView {
+  double *ptr;
+  long ld;
+  bool staged;
+  std::vector<double> buffer;
+};
+
+static void map_tile(const PhysicalRegion &region, FieldID fid,
+                     const Rect<2> &rect, TileView &tile)
+{
+  DenseBlock block = get_matrix_block(region, fid, rect);
+  const int cols = rect.dim_size(1);
+
+  tile.staged = (block.col_stride != 1);
+  if(!tile.staged) {
+    tile.ptr = block.ptr;
+    tile.ld = block.row_stride;
+    return;
+  }
+
+  tile.buffer.resize(rect.volume());
+  tile.ptr = &tile.buffer[0];
+  tile.ld = cols;
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      tile.ptr[(i - rect.lo[0]) * tile.ld + (j - rect.lo[1])] = block.at(i, j);
+}
+
+/* Writes a staged tile back to its instance */
+static void unmap_tile(const PhysicalRegion &region, FieldID fid,
+                       const Rect<2> &rect, const TileView &tile)
+{
+  if(!tile.staged)
+    return;
+
+  DenseBlock block = get_matrix_block(region, fid, rect);
+  for(int i = rect.lo[0]; i <= rect.hi[0]; i++)
+    for(int j = rect.lo[1]; j <= rect.hi[1]; j++)
+      block.at(i, j) = tile.ptr[(i - rect.lo[0]) * tile.ld + (j - rect.lo[1])];
+}
+
+void tile_getrf_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid = *(task->regions[0].privilege_fields.begin());
+  Rect<2> rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  const int m = rect.dim_size(0);
+
+  TileView tile;
+  map_tile(regions[0], fid, rect, tile);
+  double *a = tile.ptr;
+  const long lda = tile.ld;
+
+  // Pivots below eps times the largest entry of the tile lose all of its
+  // digits; a zero one leaves its column as is, as getf2 does
+  double norm = 0;
+  for(int i = 0; i < m; i++)
+    for(int j = 0; j < rect.dim_size(1); j++)
+      norm = std::max(norm, fabs(a[i * lda + j]));
+  int tiny = -1, singular = -1;
+
+  for(int kk = 0; kk < m; kk++) {
+    const double pivot = a[kk * lda + kk];
+    if(pivot == 0) {
+      if(singular < 0)
+        singular = kk;
+      continue;
+    }
+    if((tiny < 0) && (fabs(pivot) <= DBL_EPSILON * norm))
+      tiny = kk;
+    for(int i = kk + 1; i < m; i++) {
+      const double l = a[i * lda + kk] / pivot;
+      a[i * lda + kk] = l;
+      kernel_axpy(&a[i * lda + kk + 1], 1, &a[kk * lda + kk + 1], 1, -l, m - kk - 1);
+    }
+  }
+
+  if(singular >= 0)
+    log_solver.warning("tiled LU: zero pivot in row %d, the matrix needs pivoting (-lu row)",
+                       (int) rect.lo[0] + singular);
+  else if(tiny >= 0)
+    log_solver.warning("tiled LU: tiny pivot in row %d, the factors are unstable without pivoting (-lu row)",
+                       (int) rect.lo[0] + tiny);
+
+  unmap_tile(regions[0], fid, rect, tile);
+}
+
+void tile_trsm_l_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_diag = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_panel = *(task->regions[1].privilege_fields.begin());
+  Rect<2> diag_rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> panel_rect = matrix_bounds(ctx, runtime, task->regions[1]);
+  const int m = diag_rect.dim_size(0);
+  const int w = panel_rect.dim_size(1);
+
+  TileView diag, panel;
+  map_tile(regions[0], fid_diag, diag_rect, diag);
+  map_tile(regions[1], fid_panel, panel_rect, panel);
+  const double *l = diag.ptr;
+  double *a = panel.ptr;
+
+  // Forward substitution with the unit lower triangle of the diagonal tile
+  for(int i = 1; i < m; i++)
+    for(int p = 0; p < i; p++)
+      kernel_axpy(&a[i * panel.ld], 1, &a[p * panel.ld], 1, -l[i * diag.ld + p], w);
+
+  unmap_tile(regions[1], fid_panel, panel_rect, panel);
+}
+
+void tile_trsm_u_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_diag = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_panel = *(task->regions[1].privilege_fields.begin());
+  Rect<2> diag_rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> panel_rect = matrix_bounds(ctx, runtime, task->regions[1]);
+  const int m = diag_rect.dim_size(0);
+  const int h = panel_rect.dim_size(0);
+
+  TileView diag, panel;
+  map_tile(regions[0], fid_diag, diag_rect, diag);
+  map_tile(regions[1], fid_panel, panel_rect, panel);
+  const double *u = diag.ptr;
+
+  // Solve X U = A one row of the panel at a time: once x(p) is final it
+  // is eliminated from the rest of the row with row p of U
+  for(int r = 0; r < h; r++) {
+    double *row = &panel.ptr[r * panel.ld];
+    for(int p = 0; p < m; p++) {
+      row[p] /= u[p * diag.ld + p];
+      kernel_axpy(row + p + 1, 1, &u[p * diag.ld + p + 1], 1, -row[p], m - p - 1);
+    }
+  }
+
+  unmap_tile(regions[1], fid_panel, panel_rect, panel);
+}
+
+void tile_gemm_task(const Task *task,
+            const std::vector<PhysicalRegion> &regions,
+            Context ctx, HighLevelRuntime *runtime) {
+
+  FieldID fid_a = *(task->regions[0].privilege_fields.begin());
+  FieldID fid_b = *(task->regions[1].privilege_fields.begin());
+  FieldID fid_c = *(task->regions[2].privilege_fields.begin());
+  Rect<2> a_rect = matrix_bounds(ctx, runtime, task->regions[0]);
+  Rect<2> b_rect = matrix_bounds(ctx, runtime, task->regions[1]);
+  Rect<2> c_rect = matrix_bounds(ctx, runtime, task->regions[2]);
+  const int h = c_rect.dim_size(0);
+  const int w = c_rect.dim_size(1);
+  const int m = a_rect.dim_size(1);
+  assert(b_rect.dim_size(0) == m);
+
+  TileView a, b, c;
+  map_tile(regions[0], fid_a, a_rect, a);
+  map_tile(regions[1], fid_b, b_rect, b);
+  map_tile(regions[2], fid_c, c_rect, c);
+
+  // C -= A B, with i-p-j ordering so the inner loop streams rows of B and C
+  for(int i = 0; i < h; i++)
+    for(int p = 0; p < m; p++)
+      kernel_axpy(&c.ptr[i * c.ld], 1, &b.ptr[p * b.ld], 1, -a.ptr[i * a.ld + p], w);
+
+  unmap_tile(regions[2], fid_c, c_rect, c);
+}
+
+/* The owner of tile (ti, tj), p * grid.cols + q */
+int tile_owner(const ProcessGrid &grid, int num_tiles, int ti, int tj)
+{
+  if(grid.cyclic)
+    return (ti % grid.rows) * grid.cols + (tj % grid.cols);
+  return (ti * grid.rows / num_tiles) * grid.cols + (tj * grid.cols / num_tiles);
+}
+
+TaskLauncher tile_launcher(const TileMap &map, TaskID task_id, const TaskArgument &arg,
+                           int ti, int tj)
+{
+  TaskLauncher launcher(task_id, arg);
+  launcher.tag = owner_tag(map.owners[ti * map.num_tiles + tj]);
+  return launcher;
+}
+
+void add_tile(TaskLauncher &launcher, const TileMap &map, int ti, int tj,
+              PrivilegeMode privilege)
+{
+  const unsigned idx = launcher.add_region_requirement(
+    RegionRequirement(map.tiles[ti * map.num_tiles + tj], privilege, EXCLUSIVE, map.parent));
+  launcher.add_field(idx, map.fid);
+}
+
+ProcessGrid fit_grid(ProcessGrid grid, int num_tiles)
+{
+  grid.rows = std::max(1, std::min(grid.rows, num_tiles));
+  grid.cols = std::max(1, std::min(grid.cols, num_tiles));
+  return grid;
+}
+
+/*
+ * Besides the tiling, prints the flops of the tile tasks that every owner
+ * runs, for the cyclic and the contiguous distribution over grid: the
+ * ratio of the busiest owner to the mean, and the step after which the
+ * first owner runs out of tiles to update.
+ */
+void report_tiled_lu(int n, int tile_size, ProcessGrid grid)
+{
+  const int num_tiles = (n + tile_size - 1) / tile_size;
+  grid = fit_grid(grid, num_tiles);
+  printf("\n Tiled LU: %d x %d tiles of size %d, %d x %d %s grid", num_tiles, num_tiles,
+         tile_size, grid.rows, grid.cols, grid.cyclic ? "cyclic" : "block");
+
+  const int num_owners = grid.rows * grid.cols;
+  for(int pass = 0; pass < 2; pass++) {
+    grid.cyclic = (pass == 0);
+    std::vector<double> work(num_owners, 0.0);
+    std::vector<int> last_step(num_owners, -1);
+
+    for(int k = 0; k < num_tiles; k++) {
+      const double m = std::min(tile_size, n - k * tile_size);
+      for(int ti = k; ti < num_tiles; ti++) {
+        const double h = std::min(tile_size, n - ti * tile_size);
+        for(int tj = k; tj < num_tiles; tj++) {
+          const double w = std::min(tile_size, n - tj * tile_size);
+          double flops;
+          if((ti == k) && (tj == k))
+            flops = 2.0 / 3.0 * m * m * m;    // GETRF
+          else if((ti == k) || (tj == k))
+            flops = h * m * w;                // TRSM, m x m by h x w
+          else
+            flops = 2.0 * h * m * w;          // GEMM
+          const int owner = tile_owner(grid, num_tiles, ti, tj);
+          work[owner] += flops;
+          last_step[owner] = k;
+        }
+      }
+    }
+
+    double total = 0, busiest = 0;
+    int first_idle = num_tiles;
+    for(int o = 0; o < num_owners; o++) {
+      total += work[o];
+      busiest = std::max(busiest, work[o]);
+      first_idle = std::min(first_idle, last_step[o] + 1);
+    }
+    printf("\n   %-10s busiest owner %.2fx the mean, first owner idle after step %d of %d",
+           grid.cyclic ? "cyclic:" : "block:", busiest * num_owners / total,
+           first_idle, num_tiles);
+  }
+}
+
+TileMap tile_lu_matrix(Context ctx, HighLevelRuntime *runtime,
+                       LogicalRegion input_lr, int tile_size, ProcessGrid grid)
+{
+  IndexSpace is = input_lr.get_index_space();
+  Rect<2> rect = runtime->get_index_space_domain(ctx, is).get_rect<2>();
+  const int n = rect.dim_size(0);
+  const int num_tiles = (n + tile_size - 1) / tile_size;
+
+  // Every owner holds at least one tile
+  grid = fit_grid(grid, num_tiles);
+  const int num_owners = grid.rows * grid.cols;
+
+  // Tile (ti, tj) is color owner_slot[ti * num_tiles + tj] of the partition
+  // of its owner's piece into tiles
+  TileMap map;
+  map.num_tiles = num_tiles;
+  map.parent = input_lr;
+  map.fid = FID_INPUT;
+  map.tiles.resize(num_tiles * num_tiles);
+  map.owners.resize(num_tiles * num_tiles);
+  std::vector<int> owner_slot(num_tiles * num_tiles);
+  std::vector<int> num_owned(num_owners, 0);
+  MultiDomainColoring owner_coloring;
+  std::vector<DomainColoring> tile_colorings(num_owners);
+  for(int ti = 0; ti < num_tiles; ti++) {
+    for(int tj = 0; tj < num_tiles; tj++) {
+      const int row_hi = ((ti + 1) * tile_size < n) ? ((ti + 1) * tile_size - 1) : (n - 1);
+      const int col_hi = ((tj + 1) * tile_size < n) ? ((tj + 1) * tile_size - 1) : (n - 1);
+      Rect<2> tile(make_point(ti * tile_size, tj * tile_size), make_point(row_hi, col_hi));
+      Domain tile_domain = Domain::from_rect<2>(mat_rect(tile));
+
+      const int owner = tile_owner(grid, num_tiles, ti, tj);
+      map.owners[ti * num_tiles + tj] = owner;
+      owner_slot[ti * num_tiles + tj] = num_owned[owner];
+      owner_coloring[owner].insert(tile_domain);
+      tile_colorings[owner][num_owned[owner]++] = tile_domain;
+    }
+  }
+
+  Rect<1> owner_rect(Point<1>(0), Point<1>(num_owners - 1));
+  IndexPartition owner_ip = runtime->create_index_partition(ctx, is,
+      Domain::from_rect<1>(owner_rect), owner_coloring, true /* disjoint */);
+  LogicalPartition owner_lp = runtime->get_logical_partition(ctx, input_lr, owner_ip);
+
+  std::vector<LogicalPartition> tile_lps(num_owners);
+  for(int owner = 0; owner < num_owners; owner++) {
+    LogicalRegion piece = runtime->get_logical_subregion_by_color(ctx, owner_lp, owner);
+    Rect<1> slot_rect(Point<1>(0), Point<1>(num_owned[owner] - 1));
+    IndexPartition tile_ip = runtime->create_index_partition(ctx, piece.get_index_space(),
+        Domain::from_rect<1>(slot_rect), tile_colorings[owner], true /* disjoint */);
+    tile_lps[owner] = runtime->get_logical_partition(ctx, piece, tile_ip);
+  }
+  for(int t = 0; t < num_tiles * num_tiles; t++)
+    map.tiles[t] = runtime->get_logical_subregion_by_color(ctx, tile_lps[map.owners[t]],
+                                                           owner_slot[t]);
+  return map;
+}
+
+Future tiled_lu_factor(Context ctx, HighLevelRuntime *runtime, const TileMap &map)
+{
+  const int num_tiles = map.num_tiles;
+
+  // Every tile task feeds the trailing tile, so the last GETRF is the last
+  // task of the factorization to complete
+  Future last_f;
+
+  for(int k = 0; k < num_tiles; k++) {
+    // Every tile task runs on the owner of the tile it writes
+    TaskLauncher getrf_launcher = tile_launcher(map, TILE_GETRF_TASK_ID,
+                                                TaskArgument(NULL, 0), k, k);
+    add_tile(getrf_launcher, map, k, k, READ_WRITE);
+    last_f = runtime->execute_task(ctx, getrf_launcher);
+
+    for(int j = k + 1; j < num_tiles; j++) {
+      TaskLauncher trsm_launcher = tile_launcher(map, TILE_TRSM_L_TASK_ID,
+                                                 TaskArgument(NULL, 0), k, j);
+      add_tile(trsm_launcher, map, k, k, READ_ONLY);
+      add_tile(trsm_launcher, map, k, j, READ_WRITE);
+      runtime->execute_task(ctx, trsm_launcher);
+    }
+
+    for(int i = k + 1; i < num_tiles; i++) {
+      TaskLauncher trsm_launcher = tile_launcher(map, TILE_TRSM_U_TASK_ID,
+                                                 TaskArgument(NULL, 0), i, k);
+      add_tile(trsm_launcher, map, k, k, READ_ONLY);
+      add_tile(trsm_launcher, map, i, k, READ_WRITE);
+      runtime->execute_task(ctx, trsm_launcher);
+    }
+
+    for(int i = k + 1; i < num_tiles; i++) {
+      for(int j = k + 1; j < num_tiles; j++) {
+        TaskLauncher gemm_launcher = tile_launcher(map, TILE_GEMM_TASK_ID,
+                                                   TaskArgument(NULL, 0), i, j);
+        add_tile(gemm_launcher, map, i, k, READ_ONLY);
+        add_tile(gemm_launcher, map, k, j, READ_ONLY);
+        add_tile(gemm_launcher, map, i, j, READ_WRITE);
+        runtime->execute_task(ctx, gemm_launcher);
+      }
+    }
+  }
+
+  return last_f;
+}
+
+void register_tiled_lu_tasks(void)
+{
+  HighLevelRuntime::register_legion_task<tile_getrf_task>
+            (TILE_GETRF_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<tile_trsm_l_task>
+            (TILE_TRSM_L_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<tile_trsm_u_task>
+            (TILE_TRSM_U_TASK_ID, Processor::LOC_PROC, true, false);
+
+  HighLevelRuntime::register_legion_task<tile_gemm_task>
+            (TILE_GEMM_TASK_ID, Processor::LOC_PROC, true, false);
+}